@@ -22,6 +22,17 @@ class dBus extends Bundle {
     val rsp = Flipped(Decoupled(new dBus_rsp))
 }
 
+class VexRiscvDebugCmd extends Bundle {
+    val wr = Bool()
+    val address = UInt(8.W)
+    val data = UInt(32.W)
+}
+
+class VexRiscvDebugBus extends Bundle {
+    val cmd = Decoupled(new VexRiscvDebugCmd)
+    val rsp_data = Input(UInt(32.W))
+}
+
 class VexRiscv extends BlackBox {
     val io = IO(new Bundle {
         val iBus_cmd_valid = Output(Bool())
@@ -17,6 +17,9 @@ abstract class Parameters {
     def SLAVE_PORT: String
     def GATEWAY: String
     def SUBNET: String
+    // Factor by which timers derived from wall-clock time (reset debouncing,
+    // UART baud, mtime) are sped up, 1 in hardware
+    def TIME_SCALE: Int
 }
 
 object Synthesis extends Parameters {
@@ -33,6 +36,7 @@ object Synthesis extends Parameters {
     val SLAVE_PORT = "h4D4"
     val GATEWAY = "hC0A80101"
     val SUBNET = "hFFFFFFFF"
+    val TIME_SCALE = 1
 }
 
 object Simulation extends Parameters {
@@ -41,7 +45,7 @@ object Simulation extends Parameters {
     val ETHERNET_CLOCK_FREQUENCY = 125000000
     val HDMI_PIXEL_CLOCK_FREQUENCY = 148500000
     val CPU_CLOCK_FREQUENCY = 50000000
-    val UART_BAUD_RATE = 29491200
+    val UART_BAUD_RATE = 115200
     val MAC = "h000000000000"
     val IP = "h7F000080"
     val DEBUG_PORT = "h4D2"
@@ -49,6 +53,26 @@ object Simulation extends Parameters {
     val SLAVE_PORT = "h4D4"
     val GATEWAY = "h7F000001"
     val SUBNET = "hFFFFFFFF"
+    val TIME_SCALE = 256
+}
+
+// Node INDEX of a multi-node simulation on the virtual switch, with its own
+// locally administered MAC and the INDEX-th address after BASE.IP
+class Node(val BASE: Parameters, val INDEX: Int) extends Parameters {
+    val CLOCK_FREQUENCY = BASE.CLOCK_FREQUENCY
+    val UART_CLOCK_FREQUENCY = BASE.UART_CLOCK_FREQUENCY
+    val ETHERNET_CLOCK_FREQUENCY = BASE.ETHERNET_CLOCK_FREQUENCY
+    val HDMI_PIXEL_CLOCK_FREQUENCY = BASE.HDMI_PIXEL_CLOCK_FREQUENCY
+    val CPU_CLOCK_FREQUENCY = BASE.CPU_CLOCK_FREQUENCY
+    val UART_BAUD_RATE = BASE.UART_BAUD_RATE
+    val MAC = "h%012X".format((BigInt(BASE.MAC.drop(1), 16) | BigInt("020000000000", 16)) + INDEX)
+    val IP = "h%08X".format(BigInt(BASE.IP.drop(1), 16) + INDEX)
+    val DEBUG_PORT = BASE.DEBUG_PORT
+    val MASTER_PORT = BASE.MASTER_PORT
+    val SLAVE_PORT = BASE.SLAVE_PORT
+    val GATEWAY = BASE.GATEWAY
+    val SUBNET = BASE.SUBNET
+    val TIME_SCALE = BASE.TIME_SCALE
 }
 
 class top(val params: Parameters) extends Module {
@@ -65,25 +89,30 @@ class top(val params: Parameters) extends Module {
         val hdmi_audio_clock = Input(Clock())
         val hdmi = new HDMIInterface()
         val cpu_clock = Input(Clock())
+        val cpu_debug = Flipped(new VexRiscvDebugBus())
     })
 
+    // Reported by the simulation harness at startup
+    val time_scale = WireDefault(params.TIME_SCALE.U(32.W))
+    dontTouch(time_scale)
+
     val cpu_reset_out = Wire(Reset())
-    val reset_sync = Module(new SyncDebouncer(CLOCK_FREQUENCY = params.CLOCK_FREQUENCY, SAMPLE_FREQUENCY = 100, WIDTH = 1))
+    val reset_sync = Module(new SyncDebouncer(CLOCK_FREQUENCY = params.CLOCK_FREQUENCY, SAMPLE_FREQUENCY = 100, WIDTH = 1, TIME_SCALE = params.TIME_SCALE))
     reset_sync.reset := false.B
     reset_sync.io.input := reset.asUInt | cpu_reset_out.asUInt
-    val uart_reset_sync = Module(new SyncDebouncer(CLOCK_FREQUENCY = params.UART_CLOCK_FREQUENCY, SAMPLE_FREQUENCY = 100, WIDTH = 1))
+    val uart_reset_sync = Module(new SyncDebouncer(CLOCK_FREQUENCY = params.UART_CLOCK_FREQUENCY, SAMPLE_FREQUENCY = 100, WIDTH = 1, TIME_SCALE = params.TIME_SCALE))
     uart_reset_sync.reset := false.B
     uart_reset_sync.io.input := reset.asUInt | cpu_reset_out.asUInt
-    val ethernet_reset_sync = Module(new SyncDebouncer(CLOCK_FREQUENCY = params.ETHERNET_CLOCK_FREQUENCY, SAMPLE_FREQUENCY = 100, WIDTH = 1))
+    val ethernet_reset_sync = Module(new SyncDebouncer(CLOCK_FREQUENCY = params.ETHERNET_CLOCK_FREQUENCY, SAMPLE_FREQUENCY = 100, WIDTH = 1, TIME_SCALE = params.TIME_SCALE))
     ethernet_reset_sync.reset := false.B
     ethernet_reset_sync.io.input := reset.asUInt | cpu_reset_out.asUInt
-    val hdmi_reset_sync = Module(new SyncDebouncer(CLOCK_FREQUENCY = params.HDMI_PIXEL_CLOCK_FREQUENCY, SAMPLE_FREQUENCY = 100, WIDTH = 1))
+    val hdmi_reset_sync = Module(new SyncDebouncer(CLOCK_FREQUENCY = params.HDMI_PIXEL_CLOCK_FREQUENCY, SAMPLE_FREQUENCY = 100, WIDTH = 1, TIME_SCALE = params.TIME_SCALE))
     hdmi_reset_sync.reset := false.B
     hdmi_reset_sync.io.input := reset.asUInt | cpu_reset_out.asUInt
-    val cache_reset_sync = Module(new SyncDebouncer(CLOCK_FREQUENCY = params.CPU_CLOCK_FREQUENCY, SAMPLE_FREQUENCY = 100, WIDTH = 1))
+    val cache_reset_sync = Module(new SyncDebouncer(CLOCK_FREQUENCY = params.CPU_CLOCK_FREQUENCY, SAMPLE_FREQUENCY = 100, WIDTH = 1, TIME_SCALE = params.TIME_SCALE))
     cache_reset_sync.reset := false.B
     cache_reset_sync.io.input := reset.asUInt | cpu_reset_out.asUInt
-    val cpu_reset_sync = Module(new SyncDebouncer(CLOCK_FREQUENCY = params.CPU_CLOCK_FREQUENCY, SAMPLE_FREQUENCY = 100, WIDTH = 1))
+    val cpu_reset_sync = Module(new SyncDebouncer(CLOCK_FREQUENCY = params.CPU_CLOCK_FREQUENCY, SAMPLE_FREQUENCY = 100, WIDTH = 1, TIME_SCALE = params.TIME_SCALE))
     cpu_reset_sync.reset := false.B
     cpu_reset_sync.io.input := reset.asUInt
 
@@ -116,7 +145,7 @@ class top(val params: Parameters) extends Module {
                                                    DATA_WIDTH = 128,
                                                    ADDR_WIDTH = 32,
                                                    ID_WIDTH = 1))
-    val uart = Module(new UARTDriver(CLOCK_FREQUENCY = params.UART_CLOCK_FREQUENCY, BAUD_RATE = params.UART_BAUD_RATE))
+    val uart = Module(new UARTDriver(CLOCK_FREQUENCY = params.UART_CLOCK_FREQUENCY, BAUD_RATE = params.UART_BAUD_RATE, TIME_SCALE = params.TIME_SCALE))
     uart.reset := uart_reset_sync.io.output.asBool
     val uart_axi = Module(new UARTAXI(DATA_WIDTH = 128, ADDR_WIDTH = 32, ID_WIDTH = 8))
     uart_axi.reset := reset_sync.io.output.asBool
@@ -178,13 +207,23 @@ class top(val params: Parameters) extends Module {
     cpu.io.iBus_rsp_valid := icache.io.frontend.response.valid
     cpu.io.iBus_rsp_payload_error := icache.io.frontend.response.bits.error
     cpu.io.iBus_rsp_payload_inst := icache.io.frontend.response.bits.data
-    cpu.io.timerInterrupt := register_file.io.output(2)(0)
+    // Free-running machine timer, advancing TIME_SCALE ticks per clock cycle.
+    // mtime is readable in the upper half of the first register, mtimecmp is
+    // the lower half of the fourth register and bit 64 of the fourth register
+    // enables the compare.
+    val mtime = withReset(reset_sync.io.output.asBool) { RegInit(0.U(64.W)) }
+    mtime := mtime + params.TIME_SCALE.U
+    val timer_compare = register_file.io.output(3)(64) && mtime >= register_file.io.output(3)(63, 0)
+
+    cpu.io.timerInterrupt := register_file.io.output(2)(0) | timer_compare
     cpu.io.externalInterrupt := register_file.io.output(2)(1)
     cpu.io.softwareInterrupt := register_file.io.output(2)(2)
-    cpu.io.debug_bus_cmd_valid := false.B
-    cpu.io.debug_bus_cmd_payload_wr := false.B
-    cpu.io.debug_bus_cmd_payload_address := 0.U
-    cpu.io.debug_bus_cmd_payload_data := 0.U
+    cpu.io.debug_bus_cmd_valid := io.cpu_debug.cmd.valid
+    io.cpu_debug.cmd.ready := cpu.io.debug_bus_cmd_ready
+    cpu.io.debug_bus_cmd_payload_wr := io.cpu_debug.cmd.bits.wr
+    cpu.io.debug_bus_cmd_payload_address := io.cpu_debug.cmd.bits.address
+    cpu.io.debug_bus_cmd_payload_data := io.cpu_debug.cmd.bits.data
+    io.cpu_debug.rsp_data := cpu.io.debug_bus_rsp_data
     cpu.io.dBus_cmd_ready := dcache.io.frontend.request.ready
     cpu.io.dBus_rsp_ready := dcache.io.frontend.response.valid
     cpu.io.dBus_rsp_error := dcache.io.frontend.response.bits.error
@@ -253,7 +292,7 @@ class top(val params: Parameters) extends Module {
     axi_xbar.io.M_AXI(2) <> uart_axi.io.S_AXI
     axi_xbar.io.M_AXI(3) <> err_slave.io.S_AXI
 
-    register_file.io.input(0) := Cat(0.U(71.W), hdmi_audio.io.done, 0.U(24.W), io.switch)
+    register_file.io.input(0) := Cat(mtime, 0.U(31.W), hdmi_audio.io.done, 0.U(24.W), io.switch)
     io.led := register_file.io.output(1)(7, 0)
     hdmi_audio.io.address := register_file.io.output(1)(95, 64)
     hdmi_audio.io.length := register_file.io.output(1)(61, 32)
@@ -278,8 +317,13 @@ class top(val params: Parameters) extends Module {
     io.hdmi <> hdmi.io.hdmi
 }
 
+// runMain project.Instance [k] elaborates node k of a multi-node simulation
 object Instance extends App {
+    val (params, target) = args.headOption match {
+        case Some(index) => (new Node(Simulation, index.toInt), "../src/hdl/node" + index)
+        case None => (Simulation, "../src/hdl")
+    }
     (new chisel3.stage.ChiselStage).execute(
-       Array("-X", "mverilog", "--target-dir", "../src/hdl"),
-       Seq(chisel3.stage.ChiselGeneratorAnnotation(() => new top(Simulation))))
+       Array("-X", "mverilog", "--target-dir", target),
+       Seq(chisel3.stage.ChiselGeneratorAnnotation(() => new top(params))))
 }
\ No newline at end of file
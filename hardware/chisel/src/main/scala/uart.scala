@@ -147,14 +147,14 @@ class UARTAXI(val DATA_WIDTH: Int, val ADDR_WIDTH: Int, val ID_WIDTH: Int) exten
     }
 }
 
-class UARTDriver(val CLOCK_FREQUENCY: Int, val BAUD_RATE: Int) extends Module {
+class UARTDriver(val CLOCK_FREQUENCY: Int, val BAUD_RATE: Int, val TIME_SCALE: Int = 1) extends Module {
     val io = IO(new Bundle {
         val uart_clock = Input(Clock())
         val uart = new UARTInterface()
     })
 
-    val rx = Module(new UARTReceiver(CLOCK_FREQUENCY = CLOCK_FREQUENCY, BAUD_RATE = BAUD_RATE))
-    val tx = Module(new UARTTransmitter(CLOCK_FREQUENCY = CLOCK_FREQUENCY, BAUD_RATE = BAUD_RATE))
+    val rx = Module(new UARTReceiver(CLOCK_FREQUENCY = CLOCK_FREQUENCY, BAUD_RATE = BAUD_RATE, TIME_SCALE = TIME_SCALE))
+    val tx = Module(new UARTTransmitter(CLOCK_FREQUENCY = CLOCK_FREQUENCY, BAUD_RATE = BAUD_RATE, TIME_SCALE = TIME_SCALE))
 
     val rx_fifo = Module(new AXIStreamAsyncFIFO(FIFO_DEPTH = 16,
                                                 DATA_WIDTH = 8,
@@ -188,12 +188,12 @@ class UARTDriver(val CLOCK_FREQUENCY: Int, val BAUD_RATE: Int) extends Module {
     tx.io.tx.data <> tx_fifo.io.deq
 }
 
-class UARTReceiver(val CLOCK_FREQUENCY: Int, val BAUD_RATE: Int) extends Module {
+class UARTReceiver(val CLOCK_FREQUENCY: Int, val BAUD_RATE: Int, val TIME_SCALE: Int = 1) extends Module {
     val io = IO(new Bundle {
         val rx = new UARTHalf()
     })
 
-    val COUNT = CLOCK_FREQUENCY / BAUD_RATE;
+    val COUNT = CLOCK_FREQUENCY / (BAUD_RATE * TIME_SCALE);
     val WIDTH = log2Ceil(COUNT)
     
     val sample_counter = RegInit(0.U(WIDTH.W))
@@ -236,12 +236,12 @@ class UARTReceiver(val CLOCK_FREQUENCY: Int, val BAUD_RATE: Int) extends Module
     io.rx.data.bits.tdata := shift(8, 1)
 }
 
-class UARTTransmitter(val CLOCK_FREQUENCY: Int, val BAUD_RATE: Int) extends Module {
+class UARTTransmitter(val CLOCK_FREQUENCY: Int, val BAUD_RATE: Int, val TIME_SCALE: Int = 1) extends Module {
     val io = IO(new Bundle {
         val tx = Flipped(new UARTHalf())
     })
     
-    val COUNT = CLOCK_FREQUENCY / BAUD_RATE;
+    val COUNT = CLOCK_FREQUENCY / (BAUD_RATE * TIME_SCALE);
     val WIDTH = log2Ceil(COUNT)
 
     val sample_counter = RegInit(0.U(WIDTH.W))
@@ -3,7 +3,7 @@ package project
 import chisel3._
 import chisel3.util._
 
-class SyncDebouncer(val CLOCK_FREQUENCY: Int, val SAMPLE_FREQUENCY: Int, val WIDTH: Int) extends Module {
+class SyncDebouncer(val CLOCK_FREQUENCY: Int, val SAMPLE_FREQUENCY: Int, val WIDTH: Int, val TIME_SCALE: Int = 1) extends Module {
     val io = IO(new Bundle {
         val input = Input(UInt(WIDTH.W))
         val output = Output(UInt(WIDTH.W))
@@ -15,7 +15,7 @@ class SyncDebouncer(val CLOCK_FREQUENCY: Int, val SAMPLE_FREQUENCY: Int, val WID
     
     // Debouncer
     
-    val FAC = CLOCK_FREQUENCY / SAMPLE_FREQUENCY
+    val FAC = math.max(CLOCK_FREQUENCY / (SAMPLE_FREQUENCY * TIME_SCALE), 2)
     
     val input_db = Reg(UInt(WIDTH.W))
     val count = RegInit(0.U(log2Ceil(FAC).W))
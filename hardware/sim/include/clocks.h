@@ -20,7 +20,9 @@ class Clock {
         ~Clock();
         uint32_t get_state();
         uint32_t get_time_to_next_edge();
+        uint32_t get_half_period();
         void advance_time(uint32_t increment);
+        void skip_time(uint64_t increment);
 };
 
 class Clocks {
@@ -31,6 +33,7 @@ class Clocks {
         ~Clocks();
         void add_clock(std::string name, std::shared_ptr<Clock> clock);
         uint32_t next_edge();
+        void skip(uint64_t time);
 };
 
 #endif  // CLOCKS_H_
@@ -0,0 +1,41 @@
+#ifndef IDLE_H_
+#define IDLE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+// Fast-forwards simulated time while the SoC is quiescent. The harness
+// reports the idle monitor of tb on every top clock cycle and jumps over
+// the cycles that update() returns, either up to the next timer compare or
+// up to the next host event on one of the registered file descriptors.
+class IdleSkip {
+    private:
+        bool enabled;
+        bool checking;
+        uint32_t clock_period;
+        uint64_t window;
+        uint64_t margin;
+        uint64_t max_cycles;
+        uint64_t (*signature)();
+        uint64_t idle_cycles;
+        bool check_active;
+        uint64_t check_start;
+        uint64_t check_end;
+        uint64_t check_signature;
+        uint64_t skips;
+        uint64_t skipped_cycles;
+        uint64_t checks;
+        uint64_t check_failures;
+        bool wait_host_event(int timeout);
+    public:
+        IdleSkip(bool enabled, bool checking, uint32_t clock_period, uint64_t window, uint64_t max_cycles, uint64_t (*signature)());
+        ~IdleSkip();
+        uint64_t update(uint64_t time, bool idle, uint64_t timer_cycles);
+        void report();
+};
+
+// Called by transactors for every host file descriptor that can wake the SoC
+void idle_register_fd(int fd);
+
+#endif  // IDLE_H_
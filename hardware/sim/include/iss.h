@@ -0,0 +1,96 @@
+#ifndef ISS_H_
+#define ISS_H_
+
+#include <stdint.h>
+#include <assert.h>
+#include <stdio.h>
+#include <string>
+#include <memory>
+#include <vector>
+#include <deque>
+
+#define ISS_DRAM_ADDRESS 0x80000000
+#define ISS_DRAM_MASK 0xE0000000
+#define ISS_REGISTER_FILE_ADDRESS 0x60000000
+#define ISS_REGISTER_FILE_MASK 0xFFFFFFC0
+#define ISS_UART_ADDRESS 0x40000000
+#define ISS_UART_MASK 0xFFFFFFC0
+#define ISS_MTIME_WORD 2
+#define ISS_MTIMECMP_WORD 12
+// Top clock cycles per instruction, mtime advances TIME_SCALE ticks per cycle
+#define ISS_MTIME_PER_INSTRUCTION 2
+#define ISS_PAGE_SIZE 4096
+#define ISS_DRAM_WORD_SIZE 16
+#define ISS_DEBUG_STATUS_ADDRESS 0x00
+#define ISS_DEBUG_INJECT_ADDRESS 0x04
+#define ISS_DEBUG_HALT_SET (1 << 17)
+#define ISS_DEBUG_HALT_CLEAR (1 << 25)
+#define ISS_DEBUG_HALTED (1 << 1)
+#define ISS_DEBUG_PIPELINE_BUSY (1 << 2)
+
+enum ISSStopReason {
+    ISS_STOP_NONE,
+    ISS_STOP_PC,
+    ISS_STOP_INSTRUCTIONS,
+    ISS_STOP_MARKER,
+    ISS_STOP_WFI,
+    ISS_STOP_EBREAK,
+    ISS_STOP_TRAP
+};
+
+typedef struct {
+    uint32_t index;
+    uint32_t data[ISS_DRAM_WORD_SIZE / 4];
+} iss_dram_word_t;
+
+typedef struct {
+    uint32_t wr;
+    uint32_t address;
+    uint32_t data;
+} iss_debug_cmd_t;
+
+class ISSPage {
+    public:
+        uint8_t data[ISS_PAGE_SIZE];
+        ISSPage();
+};
+
+// RV32IM functional model of the VexRiscv core and the memory map of top.
+// Used to fast-forward firmware up to a point of interest before handing
+// the architectural state over to the RTL core.
+class ISS {
+    private:
+        uint32_t x[32];
+        uint32_t pc;
+        uint32_t mstatus;
+        uint32_t mie;
+        uint32_t mtvec;
+        uint32_t mscratch;
+        uint32_t mepc;
+        uint32_t mcause;
+        uint32_t mtval;
+        uint64_t instret;
+        uint32_t time_scale;
+        uint32_t register_file[16];
+        std::vector<std::unique_ptr<ISSPage>> pages;
+        ISSPage* get_page(uint32_t address, bool write);
+        bool load(uint32_t address, uint32_t size, uint32_t* value);
+        bool store(uint32_t address, uint32_t size, uint32_t value);
+        uint32_t read_csr(uint32_t csr, bool* valid);
+        bool write_csr(uint32_t csr, uint32_t value);
+        uint32_t pending_interrupts();
+        void trap(uint32_t cause, uint32_t value, bool interrupt);
+        void step();
+    public:
+        ISS();
+        ~ISS();
+        bool load_elf(const char* path);
+        void set_time_scale(uint32_t time_scale);
+        ISSStopReason run(uint32_t until_pc, uint64_t max_instructions, uint32_t marker);
+        uint64_t get_instret();
+        uint64_t get_mtime();
+        void dram_words(std::deque<iss_dram_word_t>& words);
+        void handoff_commands(std::deque<iss_debug_cmd_t>& commands);
+};
+
+#endif  // ISS_H_
@@ -0,0 +1,113 @@
+#ifndef SWITCH_H_
+#define SWITCH_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <linux/if_packet.h>
+#include <map>
+#include <deque>
+#include <vector>
+#include <string>
+
+#define SWITCH_MAX_PORTS 16
+#define SWITCH_QUEUE_DEPTH 64
+#define SWITCH_FRAME_SIZE 2048
+#define SWITCH_MAC_TABLE_SIZE 64
+#define SWITCH_FRAME_OVERHEAD 24
+#define SWITCH_TIME_DONE UINT64_MAX
+// Simulation.IP, node k of a multi-node simulation uses the k-th next address
+#define SWITCH_NODE_IP "127.0.0.128"
+#define SWITCH_HOST_IP "127.0.0.1"
+#define SWITCH_HOST_INTERFACE "lo"
+#define SWITCH_HOST_POLL_INTERVAL 1024
+#define SWITCH_HOST_PENDING 16
+
+typedef struct {
+    uint64_t time;
+    uint32_t length;
+    uint8_t data[SWITCH_FRAME_SIZE];
+} switch_frame_t;
+
+typedef struct {
+    // Simulated time in ps up to which the node on this port has finished
+    volatile uint64_t time;
+    volatile uint32_t attached;
+    volatile uint32_t count;
+    uint64_t link_free;
+    uint64_t tx_frames;
+    uint64_t rx_frames;
+    uint64_t dropped;
+    uint64_t lost;
+    // Sorted by delivery time
+    switch_frame_t frames[SWITCH_QUEUE_DEPTH];
+} switch_port_t;
+
+typedef struct {
+    uint8_t mac[6];
+    uint32_t port;
+    uint32_t valid;
+} switch_mac_entry_t;
+
+typedef struct {
+    // Robust, so a node that dies holding it does not stall the others
+    pthread_mutex_t lock;
+    // Port of the node holding the lock
+    volatile uint32_t owner;
+    volatile uint32_t initialized;
+    uint32_t n_nodes;
+    uint64_t latency;
+    uint64_t bandwidth;
+    double loss;
+    uint64_t random;
+    switch_mac_entry_t macs[SWITCH_MAC_TABLE_SIZE];
+    // Node ports followed by the host bridge port
+    switch_port_t ports[SWITCH_MAX_PORTS + 1];
+} switch_shared_t;
+
+// Virtual L2 learning switch shared between the simulation processes of a
+// multi-node simulation. Every process owns one port and synchronizes with
+// the others conservatively: it never runs more than one link latency ahead
+// of the slowest node, so no frame can arrive in its past.
+class VirtualSwitch {
+    private:
+        switch_shared_t* shared;
+        std::string name;
+        bool creator;
+        uint32_t port;
+        uint32_t host_port;
+        bool host;
+        uint64_t time;
+        // Latest time this node may reach before it has to look at the others
+        uint64_t horizon;
+        uint64_t steps;
+        int host_fd;
+        struct sockaddr_ll host_address;
+        uint32_t node_ip;
+        std::map<uint32_t, std::vector<uint8_t>> host_arp;
+        std::deque<std::vector<uint8_t>> host_pending;
+        void lock();
+        void unlock();
+        void learn(const uint8_t* mac, uint32_t port);
+        int lookup(const uint8_t* mac);
+        void enqueue(uint32_t port, const uint8_t* data, uint32_t length, uint64_t time);
+        uint32_t pop(uint32_t port, uint8_t* data, uint32_t size);
+        void forward(uint32_t ingress, const uint8_t* data, uint32_t length, uint64_t time);
+        void host_request(uint32_t ip);
+        void host_flush();
+        void host_ingress();
+        void host_egress();
+    public:
+        VirtualSwitch(const char* name, uint32_t port, uint32_t n_nodes, uint64_t latency, uint64_t bandwidth, double loss, bool host);
+        ~VirtualSwitch();
+        static VirtualSwitch* get();
+        uint64_t get_latency();
+        void attach();
+        void sync(uint64_t time);
+        void send(const uint8_t* data, uint32_t length);
+        uint32_t receive(uint8_t* data, uint32_t size);
+        void detach();
+        void report();
+};
+
+#endif  // SWITCH_H_
@@ -16,6 +16,10 @@ uint32_t Clock::get_time_to_next_edge() {
     return this->time_to_next_edge;
 }
 
+uint32_t Clock::get_half_period() {
+    return this->half_period;
+}
+
 void Clock::advance_time(uint32_t increment) {
     assert(this->time_to_next_edge - increment < this->time_to_next_edge);
     if (this->time_to_next_edge - increment == 0) {
@@ -35,6 +39,19 @@ void Clock::advance_time(uint32_t increment) {
     return;
 }
 
+void Clock::skip_time(uint64_t increment) {
+    // Edges inside the skipped interval are dropped, only the phase is kept
+    increment %= 2 * (uint64_t)this->half_period;
+    while (increment >= this->time_to_next_edge) {
+        increment -= this->time_to_next_edge;
+        this->state = !this->state;
+        this->time_to_next_edge = this->half_period;
+    }
+    this->time_to_next_edge -= increment;
+
+    return;
+}
+
 Clocks::Clocks() {
 }
 
@@ -62,4 +79,12 @@ uint32_t Clocks::next_edge() {
     }
     //printf("%d\n", min_time_to_next_edge);
     return min_time_to_next_edge;
+}
+
+void Clocks::skip(uint64_t time) {
+    for (std::map<std::string, std::shared_ptr<Clock>>::iterator it = (this->clocks).begin(); it != (this->clocks).end(); it++) {
+        (it->second)->skip_time(time);
+    }
+
+    return;
 }
\ No newline at end of file
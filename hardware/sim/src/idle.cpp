@@ -0,0 +1,140 @@
+#include <poll.h>
+#include <limits.h>
+#include <time.h>
+#include "idle.h"
+
+#define IDLE_MARGIN 16
+
+static std::vector<int> host_fds;
+
+void idle_register_fd(int fd) {
+    host_fds.push_back(fd);
+}
+
+IdleSkip::IdleSkip(bool enabled, bool checking, uint32_t clock_period, uint64_t window, uint64_t max_cycles, uint64_t (*signature)()) :
+    enabled(enabled || checking), checking(checking), clock_period(clock_period), window(window), margin(IDLE_MARGIN), max_cycles(max_cycles), signature(signature) {
+    this->idle_cycles = 0;
+    this->check_active = false;
+    this->check_start = 0;
+    this->check_end = 0;
+    this->check_signature = 0;
+    this->skips = 0;
+    this->skipped_cycles = 0;
+    this->checks = 0;
+    this->check_failures = 0;
+
+    if (this->enabled) {
+        printf("Idle %s is enabled after %lu idle cycles.\n", this->checking ? "check" : "skip", this->window);
+    }
+}
+
+IdleSkip::~IdleSkip() {
+}
+
+bool IdleSkip::wait_host_event(int timeout) {
+    std::vector<struct pollfd> fds(host_fds.size());
+    for (size_t i = 0; i < host_fds.size(); i++) {
+        fds[i].fd = host_fds[i];
+        fds[i].events = POLLIN;
+        fds[i].revents = 0;
+    }
+    return poll(fds.data(), fds.size(), timeout) > 0;
+}
+
+uint64_t IdleSkip::update(uint64_t time, bool idle, uint64_t timer_cycles) {
+    if (!this->enabled) {
+        return 0;
+    }
+
+    if (this->check_active) {
+        // Full simulation of an interval that would have been skipped
+        if (!idle && time < this->check_end) {
+            printf("Idle check failed: SoC woke up at %lu ps, %lu ps into a skip ending at %lu ps.\n", time, time - this->check_start, this->check_end);
+            this->check_failures++;
+            this->check_active = false;
+        } else if (time >= this->check_end) {
+            if (this->signature() != this->check_signature) {
+                printf("Idle check failed: CPU registers changed during the skip ending at %lu ps.\n", this->check_end);
+                this->check_failures++;
+            }
+            this->check_active = false;
+        }
+        return 0;
+    }
+
+    if (!idle) {
+        this->idle_cycles = 0;
+        return 0;
+    }
+    if (++this->idle_cycles < this->window) {
+        return 0;
+    }
+
+    uint64_t cycles;
+    const char* reason;
+    if (timer_cycles != UINT64_MAX) {
+        // Host input arriving during the jump is delivered at the end of it
+        if (this->wait_host_event(0) || timer_cycles <= this->margin) {
+            this->idle_cycles = 0;
+            return 0;
+        }
+        cycles = timer_cycles - this->margin;
+        reason = "timer compare";
+    } else {
+        // Only the host can wake the SoC up, block until it does or until
+        // +idle_max worth of time has passed in real time
+        if (host_fds.empty() || this->checking) {
+            return 0;
+        }
+        int timeout = -1;
+        if (this->max_cycles < UINT64_MAX / this->clock_period) {
+            uint64_t milliseconds = (this->max_cycles * this->clock_period + 999999999ULL) / 1000000000ULL;
+            timeout = milliseconds < INT_MAX ? (int)milliseconds : -1;
+        }
+        if (timeout < 0) {
+            printf("Idle skip at %lu ps: waiting for a host event.\n", time);
+        } else {
+            printf("Idle skip at %lu ps: waiting up to %d ms for a host event.\n", time, timeout);
+        }
+        fflush(stdout);
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        while (!this->wait_host_event(timeout) && timeout < 0);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        uint64_t waited = (end.tv_sec - start.tv_sec) * 1000000000000ULL + (end.tv_nsec - start.tv_nsec) * 1000ULL;
+        cycles = waited / this->clock_period;
+        reason = "host event";
+    }
+    if (cycles > this->max_cycles) {
+        cycles = this->max_cycles;
+    }
+    this->idle_cycles = 0;
+    if (cycles == 0) {
+        return 0;
+    }
+
+    if (this->checking) {
+        this->check_active = true;
+        this->check_start = time;
+        this->check_end = time + cycles * this->clock_period;
+        this->check_signature = this->signature();
+        this->checks++;
+        return 0;
+    }
+
+    printf("Idle skip at %lu ps: %lu cycles to the next %s.\n", time, cycles, reason);
+    this->skips++;
+    this->skipped_cycles += cycles;
+    return cycles;
+}
+
+void IdleSkip::report() {
+    if (!this->enabled) {
+        return;
+    }
+    if (this->checking) {
+        printf("Idle check: %lu of %lu skips failed.\n", this->check_failures, this->checks);
+    } else {
+        printf("Idle skip: %lu skips over %lu cycles (%.3f ms of simulated time).\n", this->skips, this->skipped_cycles, this->skipped_cycles * this->clock_period / 1e9);
+    }
+}
@@ -0,0 +1,608 @@
+#include <string.h>
+#include <elf.h>
+#include "iss.h"
+
+#define CSR_MSTATUS 0x300
+#define CSR_MISA 0x301
+#define CSR_MIE 0x304
+#define CSR_MTVEC 0x305
+#define CSR_MSCRATCH 0x340
+#define CSR_MEPC 0x341
+#define CSR_MCAUSE 0x342
+#define CSR_MTVAL 0x343
+#define CSR_MIP 0x344
+#define CSR_MCYCLE 0xB00
+#define CSR_MINSTRET 0xB02
+#define CSR_MCYCLEH 0xB80
+#define CSR_MINSTRETH 0xB82
+#define CSR_CYCLE 0xC00
+#define CSR_INSTRET 0xC02
+#define CSR_CYCLEH 0xC80
+#define CSR_INSTRETH 0xC82
+#define CSR_MVENDORID 0xF11
+#define CSR_MARCHID 0xF12
+#define CSR_MIMPID 0xF13
+#define CSR_MHARTID 0xF14
+
+#define MSTATUS_MIE (1 << 3)
+#define MSTATUS_MPIE (1 << 7)
+#define MSTATUS_MPP (3 << 11)
+#define MSTATUS_MASK (MSTATUS_MIE | MSTATUS_MPIE | MSTATUS_MPP)
+#define MIE_MASK ((1 << 3) | (1 << 7) | (1 << 11))
+
+ISSPage::ISSPage() {
+    memset(this->data, 0, sizeof(this->data));
+}
+
+ISS::ISS() : pc(ISS_DRAM_ADDRESS), mstatus(0), mie(0), mtvec(0x20), mscratch(0), mepc(0), mcause(0), mtval(0), instret(0), time_scale(1), pages((~ISS_DRAM_MASK + 1) / ISS_PAGE_SIZE) {
+    memset(this->x, 0, sizeof(this->x));
+    memset(this->register_file, 0, sizeof(this->register_file));
+}
+
+ISS::~ISS() {
+}
+
+ISSPage* ISS::get_page(uint32_t address, bool write) {
+    std::unique_ptr<ISSPage>& page = this->pages[(address & ~ISS_DRAM_MASK) / ISS_PAGE_SIZE];
+    if (!page) {
+        if (!write) {
+            return NULL;
+        }
+        page.reset(new ISSPage());
+    }
+    return page.get();
+}
+
+bool ISS::load_elf(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        printf("ISS: Cannot open %s.\n", path);
+        return false;
+    }
+
+    Elf32_Ehdr header;
+    if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.e_ident, ELFMAG, SELFMAG) != 0 || header.e_ident[EI_CLASS] != ELFCLASS32 || header.e_machine != EM_RISCV) {
+        printf("ISS: %s is not a RV32 ELF file.\n", path);
+        fclose(file);
+        return false;
+    }
+
+    for (int i = 0; i < header.e_phnum; i++) {
+        Elf32_Phdr segment;
+        fseek(file, header.e_phoff + i * header.e_phentsize, SEEK_SET);
+        if (fread(&segment, sizeof(segment), 1, file) != 1) {
+            fclose(file);
+            return false;
+        }
+        if (segment.p_type != PT_LOAD || (segment.p_paddr & ISS_DRAM_MASK) != ISS_DRAM_ADDRESS) {
+            continue;
+        }
+        std::vector<uint8_t> buffer(segment.p_memsz, 0);
+        fseek(file, segment.p_offset, SEEK_SET);
+        if (fread(buffer.data(), 1, segment.p_filesz, file) != segment.p_filesz) {
+            fclose(file);
+            return false;
+        }
+        for (uint32_t offset = 0; offset < segment.p_memsz; offset++) {
+            ISSPage* page = this->get_page(segment.p_paddr + offset, true);
+            page->data[(segment.p_paddr + offset) % ISS_PAGE_SIZE] = buffer[offset];
+        }
+    }
+    fclose(file);
+    this->pc = header.e_entry;
+
+    printf("ISS: Loaded %s with entry point %08X.\n", path, this->pc);
+
+    return true;
+}
+
+bool ISS::load(uint32_t address, uint32_t size, uint32_t* value) {
+    if ((address & ISS_DRAM_MASK) == ISS_DRAM_ADDRESS) {
+        ISSPage* page = this->get_page(address, false);
+        *value = 0;
+        if (page != NULL) {
+            memcpy(value, &(page->data[address % ISS_PAGE_SIZE]), size);
+        }
+        return true;
+    } else if ((address & ISS_REGISTER_FILE_MASK) == ISS_REGISTER_FILE_ADDRESS) {
+        uint32_t index = (address & ~ISS_REGISTER_FILE_MASK) / 4;
+        uint32_t word = this->register_file[index];
+        if (index == ISS_MTIME_WORD) {
+            word = (uint32_t)this->get_mtime();
+        } else if (index == ISS_MTIME_WORD + 1) {
+            word = (uint32_t)(this->get_mtime() >> 32);
+        }
+        *value = word >> ((address % 4) * 8);
+        return true;
+    } else if ((address & ISS_UART_MASK) == ISS_UART_ADDRESS) {
+        switch (address & ~ISS_UART_MASK) {
+            case 0x10:
+                // No receive data is ever available to the fast-forwarded core
+                *value = 0x00000000;
+                return true;
+            case 0x30:
+                // Transmit queue is always ready
+                *value = 0x80000000;
+                return true;
+            default:
+                return false;
+        }
+    }
+    return false;
+}
+
+bool ISS::store(uint32_t address, uint32_t size, uint32_t value) {
+    if ((address & ISS_DRAM_MASK) == ISS_DRAM_ADDRESS) {
+        ISSPage* page = this->get_page(address, true);
+        memcpy(&(page->data[address % ISS_PAGE_SIZE]), &value, size);
+        return true;
+    } else if ((address & ISS_REGISTER_FILE_MASK) == ISS_REGISTER_FILE_ADDRESS) {
+        uint32_t index = (address & ~ISS_REGISTER_FILE_MASK) / 4;
+        if (index < 4) {
+            // First register is read only
+            return false;
+        }
+        uint32_t shift = (address % 4) * 8;
+        uint32_t mask = (size == 4 ? 0xFFFFFFFF : ((1 << (size * 8)) - 1)) << shift;
+        this->register_file[index] = (this->register_file[index] & ~mask) | ((value << shift) & mask);
+        return true;
+    } else if ((address & ISS_UART_MASK) == ISS_UART_ADDRESS) {
+        if ((address & ~ISS_UART_MASK) == 0x20) {
+            putchar((char)value);
+            if ((char)value == '\n') {
+                fflush(stdout);
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+uint32_t ISS::read_csr(uint32_t csr, bool* valid) {
+    *valid = true;
+    switch (csr) {
+        case CSR_MSTATUS:
+            return this->mstatus;
+        case CSR_MISA:
+            return 0x40001100;
+        case CSR_MIE:
+            return this->mie;
+        case CSR_MTVEC:
+            return this->mtvec;
+        case CSR_MSCRATCH:
+            return this->mscratch;
+        case CSR_MEPC:
+            return this->mepc;
+        case CSR_MCAUSE:
+            return this->mcause;
+        case CSR_MTVAL:
+            return this->mtval;
+        case CSR_MIP:
+            return this->pending_interrupts();
+        case CSR_MCYCLE:
+        case CSR_MINSTRET:
+        case CSR_CYCLE:
+        case CSR_INSTRET:
+            return (uint32_t)this->instret;
+        case CSR_MCYCLEH:
+        case CSR_MINSTRETH:
+        case CSR_CYCLEH:
+        case CSR_INSTRETH:
+            return (uint32_t)(this->instret >> 32);
+        // Read only identification of the VexRiscv configuration
+        case CSR_MVENDORID:
+            return 0x0000000B;
+        case CSR_MARCHID:
+            return 0x00000016;
+        case CSR_MIMPID:
+            return 0x00000021;
+        case CSR_MHARTID:
+            return 0x00000000;
+        default:
+            *valid = false;
+            return 0;
+    }
+}
+
+bool ISS::write_csr(uint32_t csr, uint32_t value) {
+    switch (csr) {
+        case CSR_MSTATUS:
+            this->mstatus = value & MSTATUS_MASK;
+            return true;
+        case CSR_MISA:
+            return true;
+        case CSR_MIE:
+            this->mie = value & MIE_MASK;
+            return true;
+        case CSR_MTVEC:
+            this->mtvec = value & 0xFFFFFFFD;
+            return true;
+        case CSR_MSCRATCH:
+            this->mscratch = value;
+            return true;
+        case CSR_MEPC:
+            this->mepc = value & 0xFFFFFFFC;
+            return true;
+        case CSR_MCAUSE:
+            this->mcause = value & 0x8000000F;
+            return true;
+        case CSR_MTVAL:
+            this->mtval = value;
+            return true;
+        case CSR_MIP:
+            return true;
+        case CSR_MCYCLE:
+        case CSR_MINSTRET:
+            this->instret = (this->instret & 0xFFFFFFFF00000000ULL) | value;
+            return true;
+        case CSR_MCYCLEH:
+        case CSR_MINSTRETH:
+            this->instret = (this->instret & 0xFFFFFFFFULL) | ((uint64_t)value << 32);
+            return true;
+        default:
+            return false;
+    }
+}
+
+uint32_t ISS::pending_interrupts() {
+    // Interrupt lines are driven from the third register of the register file
+    uint32_t lines = this->register_file[8];
+    if (this->register_file[ISS_MTIMECMP_WORD + 2] & 0x1) {
+        uint64_t mtimecmp = ((uint64_t)this->register_file[ISS_MTIMECMP_WORD + 1] << 32) | this->register_file[ISS_MTIMECMP_WORD];
+        lines |= this->get_mtime() >= mtimecmp;
+    }
+    return ((lines & 0x1) << 7) | ((lines & 0x2) << 10) | ((lines & 0x4) << 1);
+}
+
+uint64_t ISS::get_mtime() {
+    // One instruction per CPU clock, TIME_SCALE mtime ticks per top clock
+    return this->instret * ISS_MTIME_PER_INSTRUCTION * this->time_scale;
+}
+
+void ISS::trap(uint32_t cause, uint32_t value, bool interrupt) {
+    this->mepc = this->pc;
+    this->mcause = (interrupt ? 0x80000000 : 0) | cause;
+    this->mtval = value;
+    this->mstatus = (this->mstatus & ~(MSTATUS_MIE | MSTATUS_MPIE)) | ((this->mstatus & MSTATUS_MIE) ? MSTATUS_MPIE : 0) | MSTATUS_MPP;
+    if (interrupt && (this->mtvec & 0x3) == 1) {
+        this->pc = (this->mtvec & 0xFFFFFFFC) + 4 * cause;
+    } else {
+        this->pc = this->mtvec & 0xFFFFFFFC;
+    }
+}
+
+void ISS::step() {
+    uint32_t instruction;
+    uint32_t next_pc = this->pc + 4;
+
+    if (this->mstatus & MSTATUS_MIE) {
+        uint32_t pending = this->pending_interrupts() & this->mie;
+        if (pending) {
+            this->trap(pending & (1 << 11) ? 11 : pending & (1 << 3) ? 3 : 7, 0, true);
+            return;
+        }
+    }
+
+    if ((this->pc & 0x3) != 0) {
+        this->trap(0, this->pc, false);
+        return;
+    }
+    if (!this->load(this->pc, 4, &instruction)) {
+        this->trap(1, this->pc, false);
+        return;
+    }
+
+    uint32_t opcode = instruction & 0x7F;
+    uint32_t rd = (instruction >> 7) & 0x1F;
+    uint32_t funct3 = (instruction >> 12) & 0x7;
+    uint32_t rs1 = (instruction >> 15) & 0x1F;
+    uint32_t rs2 = (instruction >> 20) & 0x1F;
+    uint32_t funct7 = instruction >> 25;
+    uint32_t a = this->x[rs1];
+    uint32_t b = this->x[rs2];
+    int32_t imm_i = (int32_t)instruction >> 20;
+    int32_t imm_s = ((int32_t)(instruction & 0xFE000000) >> 20) | ((instruction >> 7) & 0x1F);
+    int32_t imm_b = ((int32_t)(instruction & 0x80000000) >> 19) | ((instruction & 0x80) << 4) | ((instruction >> 20) & 0x7E0) | ((instruction >> 7) & 0x1E);
+    int32_t imm_j = ((int32_t)(instruction & 0x80000000) >> 11) | (instruction & 0xFF000) | ((instruction >> 9) & 0x800) | ((instruction >> 20) & 0x7FE);
+    uint32_t result = 0;
+    bool write_back = true;
+    bool illegal = false;
+
+    switch (opcode) {
+        case 0x37: // LUI
+            result = instruction & 0xFFFFF000;
+            break;
+        case 0x17: // AUIPC
+            result = this->pc + (instruction & 0xFFFFF000);
+            break;
+        case 0x6F: // JAL
+            result = next_pc;
+            next_pc = this->pc + imm_j;
+            break;
+        case 0x67: // JALR
+            result = next_pc;
+            next_pc = (a + imm_i) & 0xFFFFFFFE;
+            break;
+        case 0x63: { // Branches
+            bool taken;
+            write_back = false;
+            switch (funct3) {
+                case 0: taken = a == b; break;
+                case 1: taken = a != b; break;
+                case 4: taken = (int32_t)a < (int32_t)b; break;
+                case 5: taken = (int32_t)a >= (int32_t)b; break;
+                case 6: taken = a < b; break;
+                case 7: taken = a >= b; break;
+                default: taken = false; illegal = true; break;
+            }
+            if (taken) {
+                next_pc = this->pc + imm_b;
+            }
+            break;
+        }
+        case 0x03: { // Loads
+            uint32_t address = a + imm_i;
+            uint32_t size = 1 << (funct3 & 0x3);
+            if (funct3 == 3 || funct3 > 5) {
+                illegal = true;
+                break;
+            }
+            if (address & (size - 1)) {
+                this->trap(4, address, false);
+                return;
+            }
+            if (!this->load(address, size, &result)) {
+                this->trap(5, address, false);
+                return;
+            }
+            switch (funct3) {
+                case 0: result = (int32_t)(int8_t)result; break;
+                case 1: result = (int32_t)(int16_t)result; break;
+                case 2: break;
+                case 4: result &= 0xFF; break;
+                case 5: result &= 0xFFFF; break;
+            }
+            break;
+        }
+        case 0x23: { // Stores
+            uint32_t address = a + imm_s;
+            uint32_t size = 1 << funct3;
+            write_back = false;
+            if (funct3 > 2) {
+                illegal = true;
+                break;
+            }
+            if (address & (size - 1)) {
+                this->trap(6, address, false);
+                return;
+            }
+            if (!this->store(address, size, b)) {
+                this->trap(7, address, false);
+                return;
+            }
+            break;
+        }
+        case 0x13: // Immediate arithmetic
+            switch (funct3) {
+                case 0: result = a + imm_i; break;
+                case 1: result = a << rs2; illegal = funct7 != 0; break;
+                case 2: result = (int32_t)a < imm_i; break;
+                case 3: result = a < (uint32_t)imm_i; break;
+                case 4: result = a ^ imm_i; break;
+                case 5:
+                    if (funct7 == 0x20) {
+                        result = (int32_t)a >> rs2;
+                    } else {
+                        result = a >> rs2;
+                        illegal = funct7 != 0;
+                    }
+                    break;
+                case 6: result = a | imm_i; break;
+                case 7: result = a & imm_i; break;
+            }
+            break;
+        case 0x33: // Register arithmetic
+            if (funct7 == 0x01) {
+                switch (funct3) {
+                    case 0: result = a * b; break;
+                    case 1: result = (uint32_t)(((int64_t)(int32_t)a * (int64_t)(int32_t)b) >> 32); break;
+                    case 2: result = (uint32_t)(((int64_t)(int32_t)a * (uint64_t)b) >> 32); break;
+                    case 3: result = (uint32_t)(((uint64_t)a * (uint64_t)b) >> 32); break;
+                    case 4:
+                        if (b == 0) {
+                            result = 0xFFFFFFFF;
+                        } else if (a == 0x80000000 && b == 0xFFFFFFFF) {
+                            result = a;
+                        } else {
+                            result = (int32_t)a / (int32_t)b;
+                        }
+                        break;
+                    case 5: result = b == 0 ? 0xFFFFFFFF : a / b; break;
+                    case 6:
+                        if (b == 0) {
+                            result = a;
+                        } else if (a == 0x80000000 && b == 0xFFFFFFFF) {
+                            result = 0;
+                        } else {
+                            result = (int32_t)a % (int32_t)b;
+                        }
+                        break;
+                    case 7: result = b == 0 ? a : a % b; break;
+                }
+            } else if (funct7 == 0x00 || funct7 == 0x20) {
+                switch (funct3) {
+                    case 0: result = funct7 ? a - b : a + b; break;
+                    case 1: result = a << (b & 0x1F); break;
+                    case 2: result = (int32_t)a < (int32_t)b; break;
+                    case 3: result = a < b; break;
+                    case 4: result = a ^ b; break;
+                    case 5: result = funct7 ? (uint32_t)((int32_t)a >> (b & 0x1F)) : a >> (b & 0x1F); break;
+                    case 6: result = a | b; break;
+                    case 7: result = a & b; break;
+                }
+                illegal = funct7 == 0x20 && funct3 != 0 && funct3 != 5;
+            } else {
+                illegal = true;
+            }
+            break;
+        case 0x0F: // FENCE, FENCE.I
+            write_back = false;
+            break;
+        case 0x73: // SYSTEM
+            if (funct3 == 0) {
+                write_back = false;
+                switch (instruction) {
+                    case 0x00000073: // ECALL
+                        this->trap(11, 0, false);
+                        return;
+                    case 0x30200073: // MRET
+                        next_pc = this->mepc;
+                        this->mstatus = (this->mstatus & ~(MSTATUS_MIE | MSTATUS_MPP)) | ((this->mstatus & MSTATUS_MPIE) ? MSTATUS_MIE : 0) | MSTATUS_MPIE;
+                        break;
+                    case 0x10500073: // WFI
+                        break;
+                    default:
+                        illegal = true;
+                        break;
+                }
+            } else if (funct3 != 4) {
+                uint32_t csr = instruction >> 20;
+                uint32_t operand = (funct3 & 0x4) ? rs1 : a;
+                bool valid;
+                result = this->read_csr(csr, &valid);
+                if (!valid) {
+                    illegal = true;
+                    break;
+                }
+                bool write = (funct3 & 0x3) == 1 || rs1 != 0;
+                if (write) {
+                    uint32_t value = (funct3 & 0x3) == 1 ? operand : (funct3 & 0x3) == 2 ? result | operand : result & ~operand;
+                    if (!this->write_csr(csr, value)) {
+                        // Writing a read only CSR is illegal, as on the RTL core
+                        illegal = true;
+                        break;
+                    }
+                }
+            } else {
+                illegal = true;
+            }
+            break;
+        default:
+            illegal = true;
+            break;
+    }
+
+    if (illegal) {
+        this->trap(2, instruction, false);
+        return;
+    }
+    if ((next_pc & 0x3) != 0) {
+        this->trap(0, next_pc, false);
+        return;
+    }
+    if (write_back && rd != 0) {
+        this->x[rd] = result;
+    }
+    this->pc = next_pc;
+    this->instret++;
+}
+
+void ISS::set_time_scale(uint32_t time_scale) {
+    this->time_scale = time_scale;
+}
+
+// Traps do not retire, so the bound counts every step rather than instret
+ISSStopReason ISS::run(uint32_t until_pc, uint64_t max_instructions, uint32_t marker) {
+    for (uint64_t steps = 0; ; steps++) {
+        if (this->pc == until_pc) {
+            return ISS_STOP_PC;
+        }
+        if (steps >= max_instructions) {
+            return ISS_STOP_INSTRUCTIONS;
+        }
+        uint32_t instruction;
+        if (!this->load(this->pc, 4, &instruction)) {
+            // The fetch fault would trap to the vector forever
+            if (!this->load(this->mtvec & 0xFFFFFFFC, 4, &instruction)) {
+                printf("ISS: Fetch from %08X faults and trap vector %08X is not fetchable.\n", this->pc, this->mtvec & 0xFFFFFFFC);
+                return ISS_STOP_TRAP;
+            }
+        } else {
+            if (marker != 0 && instruction == marker) {
+                return ISS_STOP_MARKER;
+            }
+            if (instruction == 0x00100073) {
+                return ISS_STOP_EBREAK;
+            }
+            if (instruction == 0x10500073 && !(this->pending_interrupts() & this->mie)) {
+                // Waiting is left to the RTL core, which takes over mtime and
+                // mtimecmp, so idle-skip can fast-forward it
+                return ISS_STOP_WFI;
+            }
+        }
+        this->step();
+    }
+}
+
+uint64_t ISS::get_instret() {
+    return this->instret;
+}
+
+// Every page the ISS holds is handed over, the RTL DRAM may have been
+// preloaded with a different image than the ELF that was fast-forwarded
+void ISS::dram_words(std::deque<iss_dram_word_t>& words) {
+    for (uint32_t page_number = 0; page_number < this->pages.size(); page_number++) {
+        if (!this->pages[page_number]) {
+            continue;
+        }
+        for (uint32_t offset = 0; offset < ISS_PAGE_SIZE; offset += ISS_DRAM_WORD_SIZE) {
+            iss_dram_word_t word;
+            word.index = (page_number * ISS_PAGE_SIZE + offset) / ISS_DRAM_WORD_SIZE;
+            memcpy(word.data, &(this->pages[page_number]->data[offset]), ISS_DRAM_WORD_SIZE);
+            words.push_back(word);
+        }
+    }
+}
+
+static void push_load_immediate(std::deque<iss_debug_cmd_t>& commands, uint32_t rd, uint32_t value) {
+    uint32_t upper = (value + 0x800) & 0xFFFFF000;
+    uint32_t lower = value & 0xFFF;
+    commands.push_back({1, ISS_DEBUG_INJECT_ADDRESS, upper | (rd << 7) | 0x37});
+    commands.push_back({1, ISS_DEBUG_INJECT_ADDRESS, (lower << 20) | (rd << 15) | (rd << 7) | 0x13});
+}
+
+static void push_csr_write(std::deque<iss_debug_cmd_t>& commands, uint32_t csr, uint32_t value) {
+    push_load_immediate(commands, 1, value);
+    commands.push_back({1, ISS_DEBUG_INJECT_ADDRESS, (csr << 20) | (1 << 15) | (1 << 12) | 0x73});
+}
+
+// Builds the debug bus sequence that moves the architectural state into a
+// halted VexRiscv. The writable registers of the register file are stored
+// first, through x1 and x2, and x1 is used as a scratch register for the
+// CSRs and restored last.
+void ISS::handoff_commands(std::deque<iss_debug_cmd_t>& commands) {
+    for (uint32_t index = 4; index < 16; index++) {
+        push_load_immediate(commands, 1, ISS_REGISTER_FILE_ADDRESS + index * 4);
+        push_load_immediate(commands, 2, this->register_file[index]);
+        commands.push_back({1, ISS_DEBUG_INJECT_ADDRESS, (2 << 20) | (1 << 15) | (2 << 12) | 0x23});
+    }
+    push_csr_write(commands, CSR_MTVEC, this->mtvec);
+    push_csr_write(commands, CSR_MIE, this->mie);
+    push_csr_write(commands, CSR_MSCRATCH, this->mscratch);
+    push_csr_write(commands, CSR_MEPC, this->mepc);
+    push_csr_write(commands, CSR_MCAUSE, this->mcause);
+    push_csr_write(commands, CSR_MTVAL, this->mtval);
+    // The ISS counts one cycle per retired instruction
+    push_csr_write(commands, CSR_MCYCLE, (uint32_t)this->instret);
+    push_csr_write(commands, CSR_MCYCLEH, (uint32_t)(this->instret >> 32));
+    push_csr_write(commands, CSR_MINSTRET, (uint32_t)this->instret);
+    push_csr_write(commands, CSR_MINSTRETH, (uint32_t)(this->instret >> 32));
+    push_csr_write(commands, CSR_MSTATUS, this->mstatus);
+    for (uint32_t rd = 2; rd < 32; rd++) {
+        push_load_immediate(commands, rd, this->x[rd]);
+    }
+    push_load_immediate(commands, 1, this->pc);
+    commands.push_back({1, ISS_DEBUG_INJECT_ADDRESS, (1 << 15) | 0x67});
+    push_load_immediate(commands, 1, this->x[1]);
+    commands.push_back({1, ISS_DEBUG_STATUS_ADDRESS, ISS_DEBUG_HALT_CLEAR});
+}
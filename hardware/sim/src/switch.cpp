@@ -0,0 +1,414 @@
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <net/ethernet.h>
+#include <netinet/ip.h>
+#include <arpa/inet.h>
+#include "switch.h"
+
+// Locally administered MAC the host bridge uses on the switch
+static const uint8_t host_mac[6] = {0x02, 0xFF, 0xFF, 0xFF, 0xFF, 0xFE};
+
+static VirtualSwitch* instance = NULL;
+
+VirtualSwitch::VirtualSwitch(const char* name, uint32_t port, uint32_t n_nodes, uint64_t latency, uint64_t bandwidth, double loss, bool host) :
+    name(std::string("/") + name), port(port), host_port(n_nodes), host(host) {
+    this->time = 0;
+    this->horizon = 0;
+    this->steps = 0;
+    this->host_fd = -1;
+    this->node_ip = ntohl(inet_addr(SWITCH_NODE_IP));
+
+    if (n_nodes == 0 || n_nodes > SWITCH_MAX_PORTS || port >= n_nodes) {
+        printf("Virtual switch port %u of %u nodes is invalid.\n", port, n_nodes);
+        exit(1);
+    }
+
+    // The first process to arrive creates and configures the switch
+    int fd = shm_open(this->name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0666);
+    this->creator = fd >= 0;
+    if (this->creator) {
+        if (ftruncate(fd, sizeof(switch_shared_t)) != 0) {
+            printf("Virtual switch %s cannot be created.\n", name);
+            exit(1);
+        }
+    } else {
+        fd = shm_open(this->name.c_str(), O_RDWR, 0666);
+        struct stat status;
+        while (fd >= 0 && fstat(fd, &status) == 0 && (size_t)status.st_size < sizeof(switch_shared_t)) {
+            usleep(1000);
+        }
+    }
+    if (fd < 0) {
+        printf("Virtual switch %s cannot be opened.\n", name);
+        exit(1);
+    }
+    this->shared = (switch_shared_t*)mmap(NULL, sizeof(switch_shared_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (this->creator) {
+        pthread_mutexattr_t attributes;
+        pthread_mutexattr_init(&attributes);
+        pthread_mutexattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attributes, PTHREAD_MUTEX_ROBUST);
+        pthread_mutex_init(&(this->shared->lock), &attributes);
+        pthread_mutexattr_destroy(&attributes);
+        this->shared->n_nodes = n_nodes;
+        this->shared->latency = latency;
+        this->shared->bandwidth = bandwidth;
+        this->shared->loss = loss;
+        this->shared->random = 0x9E3779B97F4A7C15ULL;
+        __sync_synchronize();
+        this->shared->initialized = 1;
+    } else {
+        while (!this->shared->initialized) {
+            usleep(1000);
+        }
+        if (this->shared->n_nodes != n_nodes) {
+            printf("Virtual switch %s has %u nodes, not %u.\n", name, this->shared->n_nodes, n_nodes);
+            exit(1);
+        }
+    }
+
+    if (this->host) {
+        this->host_fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+        bzero(&(this->host_address), sizeof(this->host_address));
+        (this->host_address).sll_family = AF_PACKET;
+        (this->host_address).sll_ifindex = if_nametoindex(SWITCH_HOST_INTERFACE);
+        (this->host_address).sll_protocol = htons(ETH_P_ALL);
+        (this->host_address).sll_halen = ETH_ALEN;
+        fcntl(this->host_fd, F_SETFL, fcntl(this->host_fd, F_GETFL, 0) | O_NONBLOCK);
+        bind(this->host_fd, (struct sockaddr*)&(this->host_address), sizeof(this->host_address));
+    }
+
+    instance = this;
+
+    printf("Virtual switch %s port %u is ready: %u nodes, %lu ps latency, %lu bit/s, %.3f%% loss%s.\n",
+           name, port, this->shared->n_nodes, this->shared->latency, this->shared->bandwidth, this->shared->loss * 100,
+           this->host ? ", bridged to the host" : "");
+}
+
+VirtualSwitch::~VirtualSwitch() {
+    if (this->host_fd >= 0) {
+        close(this->host_fd);
+    }
+    munmap(this->shared, sizeof(switch_shared_t));
+    if (instance == this) {
+        instance = NULL;
+    }
+}
+
+VirtualSwitch* VirtualSwitch::get() {
+    return instance;
+}
+
+uint64_t VirtualSwitch::get_latency() {
+    return this->shared->latency;
+}
+
+void VirtualSwitch::attach() {
+    switch_port_t* self = &(this->shared->ports[this->port]);
+    self->time = 0;
+    __sync_synchronize();
+    self->attached = 1;
+    if (this->host) {
+        this->shared->ports[this->host_port].attached = 1;
+    }
+
+    // Nobody starts before every node has joined at time 0
+    bool ready = false;
+    while (!ready) {
+        ready = true;
+        for (uint32_t p = 0; p < this->shared->n_nodes; p++) {
+            ready = ready && this->shared->ports[p].attached != 0;
+        }
+        if (!ready) {
+            usleep(1000);
+        }
+    }
+    printf("Virtual switch port %u is attached.\n", this->port);
+}
+
+// Only publishes and looks at the other nodes when time crosses the cached
+// horizon, which is about once per link latency
+void VirtualSwitch::sync(uint64_t time) {
+    if (time > this->horizon) {
+        switch_port_t* self = &(this->shared->ports[this->port]);
+        // Everything up to the current time has been simulated
+        __sync_synchronize();
+        self->time = this->time;
+
+        while (true) {
+            uint64_t others = SWITCH_TIME_DONE;
+            for (uint32_t p = 0; p < this->shared->n_nodes; p++) {
+                if (p != this->port && this->shared->ports[p].time < others) {
+                    others = this->shared->ports[p].time;
+                }
+            }
+            // Frames sent after the others' time cannot arrive before it
+            // plus the latency
+            this->horizon = others == SWITCH_TIME_DONE ? SWITCH_TIME_DONE : others + this->shared->latency;
+            if (time <= this->horizon) {
+                break;
+            }
+            if (this->host) {
+                this->host_ingress();
+            }
+            sched_yield();
+        }
+    }
+
+    this->time = time;
+    if (this->host && ++this->steps % SWITCH_HOST_POLL_INTERVAL == 0) {
+        this->host_ingress();
+        this->host_egress();
+    }
+}
+
+void VirtualSwitch::lock() {
+    if (pthread_mutex_lock(&(this->shared->lock)) == EOWNERDEAD) {
+        // The previous owner died inside the switch, it will not sync again
+        switch_port_t* dead = &(this->shared->ports[this->shared->owner]);
+        printf("Virtual switch port %u died holding the switch.\n", this->shared->owner);
+        __atomic_store_n(&(dead->attached), 2, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&(dead->time), SWITCH_TIME_DONE, __ATOMIC_SEQ_CST);
+        pthread_mutex_consistent(&(this->shared->lock));
+    }
+    this->shared->owner = this->port;
+}
+
+void VirtualSwitch::unlock() {
+    pthread_mutex_unlock(&(this->shared->lock));
+}
+
+void VirtualSwitch::learn(const uint8_t* mac, uint32_t port) {
+    int free = -1;
+    for (int i = 0; i < SWITCH_MAC_TABLE_SIZE; i++) {
+        switch_mac_entry_t* entry = &(this->shared->macs[i]);
+        if (entry->valid && memcmp(entry->mac, mac, 6) == 0) {
+            entry->port = port;
+            return;
+        }
+        if (!entry->valid && free < 0) {
+            free = i;
+        }
+    }
+    if (free >= 0 && !(mac[0] & 0x1)) {
+        memcpy(this->shared->macs[free].mac, mac, 6);
+        this->shared->macs[free].port = port;
+        this->shared->macs[free].valid = 1;
+    }
+}
+
+int VirtualSwitch::lookup(const uint8_t* mac) {
+    for (int i = 0; i < SWITCH_MAC_TABLE_SIZE; i++) {
+        switch_mac_entry_t* entry = &(this->shared->macs[i]);
+        if (entry->valid && memcmp(entry->mac, mac, 6) == 0) {
+            return entry->port;
+        }
+    }
+    return -1;
+}
+
+void VirtualSwitch::enqueue(uint32_t port, const uint8_t* data, uint32_t length, uint64_t time) {
+    switch_port_t* egress = &(this->shared->ports[port]);
+
+    uint64_t random = this->shared->random;
+    random ^= random << 13;
+    random ^= random >> 7;
+    random ^= random << 17;
+    this->shared->random = random;
+    if ((random >> 11) * (1.0 / 9007199254740992.0) < this->shared->loss) {
+        egress->lost++;
+        return;
+    }
+    if (egress->count == SWITCH_QUEUE_DEPTH || length > SWITCH_FRAME_SIZE) {
+        egress->dropped++;
+        return;
+    }
+
+    // Frames leave the egress link one after another at the link bandwidth
+    uint64_t serialization = this->shared->bandwidth ? (length + SWITCH_FRAME_OVERHEAD) * 8 * 1000000000000ULL / this->shared->bandwidth : 0;
+    uint64_t arrival = time + this->shared->latency;
+    if (egress->link_free > arrival) {
+        arrival = egress->link_free;
+    }
+    arrival += serialization;
+    egress->link_free = arrival;
+
+    uint32_t i = egress->count;
+    while (i > 0 && egress->frames[i - 1].time > arrival) {
+        egress->frames[i] = egress->frames[i - 1];
+        i--;
+    }
+    egress->frames[i].time = arrival;
+    egress->frames[i].length = length;
+    memcpy(egress->frames[i].data, data, length);
+    __sync_synchronize();
+    egress->count++;
+}
+
+void VirtualSwitch::forward(uint32_t ingress, const uint8_t* data, uint32_t length, uint64_t time) {
+    if (length < ETH_HLEN) {
+        return;
+    }
+    this->lock();
+    this->learn(data + ETH_ALEN, ingress);
+    this->shared->ports[ingress].tx_frames++;
+    int destination = (data[0] & 0x1) ? -1 : this->lookup(data);
+    for (uint32_t p = 0; p <= this->shared->n_nodes; p++) {
+        if (p == ingress || this->shared->ports[p].attached != 1) {
+            continue;
+        }
+        if (destination >= 0 && (uint32_t)destination != p) {
+            continue;
+        }
+        this->enqueue(p, data, length, time);
+    }
+    this->unlock();
+}
+
+uint32_t VirtualSwitch::pop(uint32_t port, uint8_t* data, uint32_t size) {
+    switch_port_t* self = &(this->shared->ports[port]);
+    if (self->count == 0 || self->frames[0].time > this->time) {
+        return 0;
+    }
+    this->lock();
+    uint32_t length = self->frames[0].length < size ? self->frames[0].length : size;
+    memcpy(data, self->frames[0].data, length);
+    for (uint32_t i = 1; i < self->count; i++) {
+        self->frames[i - 1] = self->frames[i];
+    }
+    self->count--;
+    self->rx_frames++;
+    this->unlock();
+    return length;
+}
+
+void VirtualSwitch::send(const uint8_t* data, uint32_t length) {
+    this->forward(this->port, data, length, this->time);
+}
+
+uint32_t VirtualSwitch::receive(uint8_t* data, uint32_t size) {
+    return this->pop(this->port, data, size);
+}
+
+void VirtualSwitch::host_request(uint32_t ip) {
+    // The loopback interface has no ARP, so the bridge resolves node MACs
+    uint8_t frame[60];
+    memset(frame, 0, sizeof(frame));
+    memset(frame, 0xFF, ETH_ALEN);
+    memcpy(frame + ETH_ALEN, host_mac, ETH_ALEN);
+    frame[12] = 0x08;
+    frame[13] = 0x06;
+    frame[15] = 0x01;
+    frame[16] = 0x08;
+    frame[18] = ETH_ALEN;
+    frame[19] = 4;
+    frame[21] = 0x01;
+    memcpy(frame + 22, host_mac, ETH_ALEN);
+    uint32_t host_ip = inet_addr(SWITCH_HOST_IP);
+    memcpy(frame + 28, &host_ip, 4);
+    uint32_t target_ip = htonl(ip);
+    memcpy(frame + 38, &target_ip, 4);
+    this->forward(this->host_port, frame, sizeof(frame), this->time);
+}
+
+void VirtualSwitch::host_flush() {
+    for (size_t i = 0; i < this->host_pending.size();) {
+        std::vector<uint8_t>& frame = this->host_pending[i];
+        struct iphdr* iph = (struct iphdr*)(frame.data() + ETH_HLEN);
+        std::map<uint32_t, std::vector<uint8_t>>::iterator mac = this->host_arp.find(ntohl(iph->daddr));
+        if (mac == this->host_arp.end()) {
+            i++;
+            continue;
+        }
+        memcpy(frame.data(), mac->second.data(), ETH_ALEN);
+        memcpy(frame.data() + ETH_ALEN, host_mac, ETH_ALEN);
+        this->forward(this->host_port, frame.data(), frame.size(), this->time);
+        this->host_pending.erase(this->host_pending.begin() + i);
+    }
+}
+
+void VirtualSwitch::host_ingress() {
+    uint8_t buffer[SWITCH_FRAME_SIZE];
+    struct sockaddr_ll from;
+    socklen_t from_length = sizeof(from);
+    int size;
+    while ((size = recvfrom(this->host_fd, buffer, sizeof(buffer), 0, (struct sockaddr*)&from, &from_length)) > 0) {
+        from_length = sizeof(from);
+        if (from.sll_pkttype == PACKET_OUTGOING || size < (int)(ETH_HLEN + sizeof(struct iphdr)) || buffer[12] != 0x08 || buffer[13] != 0x00) {
+            continue;
+        }
+        struct iphdr* iph = (struct iphdr*)(buffer + ETH_HLEN);
+        uint32_t destination = ntohl(iph->daddr);
+        if (destination < this->node_ip || destination >= this->node_ip + this->shared->n_nodes) {
+            continue;
+        }
+        if (this->host_pending.size() < SWITCH_HOST_PENDING) {
+            this->host_pending.push_back(std::vector<uint8_t>(buffer, buffer + size));
+        }
+        if (this->host_arp.find(destination) == this->host_arp.end()) {
+            this->host_request(destination);
+        }
+    }
+    this->host_flush();
+}
+
+void VirtualSwitch::host_egress() {
+    uint8_t buffer[SWITCH_FRAME_SIZE];
+    uint32_t length;
+    while ((length = this->pop(this->host_port, buffer, sizeof(buffer))) > 0) {
+        if (length >= 42 && buffer[12] == 0x08 && buffer[13] == 0x06 && buffer[21] == 0x02) {
+            uint32_t ip;
+            memcpy(&ip, buffer + 28, 4);
+            this->host_arp[ntohl(ip)] = std::vector<uint8_t>(buffer + 22, buffer + 28);
+            continue;
+        }
+        if (length < ETH_HLEN + sizeof(struct iphdr) || buffer[12] != 0x08 || buffer[13] != 0x00) {
+            continue;
+        }
+        struct iphdr* iph = (struct iphdr*)(buffer + ETH_HLEN);
+        this->host_arp[ntohl(iph->saddr)] = std::vector<uint8_t>(buffer + ETH_ALEN, buffer + 2 * ETH_ALEN);
+        memset(buffer, 0, 2 * ETH_ALEN);
+        sendto(this->host_fd, buffer, length, 0, (struct sockaddr*)&(this->host_address), sizeof(this->host_address));
+    }
+    this->host_flush();
+}
+
+// Lock free, so it is safe from a signal handler that interrupted this
+// process inside the switch
+void VirtualSwitch::detach() {
+    __atomic_store_n(&(this->shared->ports[this->port].attached), 2, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&(this->shared->ports[this->port].time), SWITCH_TIME_DONE, __ATOMIC_SEQ_CST);
+    if (this->host) {
+        __atomic_store_n(&(this->shared->ports[this->host_port].attached), 2, __ATOMIC_SEQ_CST);
+    }
+    bool done = true;
+    for (uint32_t p = 0; p < this->shared->n_nodes; p++) {
+        done = done && this->shared->ports[p].attached == 2;
+    }
+    // The last node out removes the switch
+    if (done) {
+        shm_unlink(this->name.c_str());
+    }
+}
+
+void VirtualSwitch::report() {
+    std::vector<uint32_t> ports(1, this->port);
+    if (this->host) {
+        ports.push_back(this->host_port);
+    }
+    for (std::vector<uint32_t>::iterator it = ports.begin(); it != ports.end(); it++) {
+        switch_port_t* p = &(this->shared->ports[*it]);
+        printf("Virtual switch %s %u: %lu frames sent, %lu received, %lu dropped, %lu lost.\n",
+               *it == this->host_port ? "host port" : "port", *it, p->tx_frames, p->rx_frames, p->dropped, p->lost);
+    }
+}
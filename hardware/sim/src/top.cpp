@@ -1,15 +1,41 @@
 #include <stdlib.h>
+#include <string.h>
 #include <signal.h>
 #include <memory>
 #include "Vtb.h"
+#include "Vtb__Dpi.h"
 #include "verilated.h"
 #include "verilated_vcd_c.h"
 #include "clocks.h"
+#include "idle.h"
+#include "switch.h"
 
 Vtb* tb;
 VerilatedVcdC* tfp;
+IdleSkip* idle = NULL;
+VirtualSwitch* fabric = NULL;
+
+uint64_t plusarg_value(VerilatedContext* contextp, const char* name, uint64_t value) {
+    const char* arg = contextp->commandArgsPlusMatch(name);
+    if (arg[0] != '\0') {
+        value = strtoull(arg + strlen(name) + 1, NULL, 0);
+    }
+    return value;
+}
+
+uint64_t signature() {
+    return (uint64_t)idle_signature();
+}
 
 void signal_callback_handler(int signum) {
+    if (fabric != NULL) {
+        fabric->detach();
+        fabric->report();
+    }
+    // Not created yet while the switch waits for the other nodes
+    if (idle != NULL) {
+        idle->report();
+    }
     tfp->close();
     tb->final();
     // Terminate program
@@ -43,6 +69,43 @@ int main(int argc, char** argv, char** env) {
     clocks.add_clock("hdmi_audio_clock", hdmi_audio_clock);
     clocks.add_clock("cpu_clock", cpu_clock);
 
+    // +switch=<name> makes this simulation node +switch_port of +switch_nodes
+    // on a virtual switch shared with the other node processes. The link
+    // latency in ps is also the granularity the nodes synchronize at.
+    fabric = NULL;
+    const char* switch_name = contextp->commandArgsPlusMatch("switch=");
+    if (switch_name[0] != '\0') {
+        uint64_t latency = plusarg_value(contextp.get(), "switch_latency=", 1000000);
+        if (latency < 2 * top_clock->get_half_period()) {
+            printf("Virtual switch latency %lu ps is below one clock period.\n", latency);
+            latency = 2 * top_clock->get_half_period();
+        }
+        const char* loss = contextp->commandArgsPlusMatch("switch_loss=");
+        fabric = new VirtualSwitch(switch_name + strlen("switch=") + 1,
+                                   plusarg_value(contextp.get(), "switch_port=", 0),
+                                   plusarg_value(contextp.get(), "switch_nodes=", 1),
+                                   latency,
+                                   plusarg_value(contextp.get(), "switch_bandwidth=", 1000000000),
+                                   loss[0] != '\0' ? strtod(loss + strlen("switch_loss=") + 1, NULL) : 0.0,
+                                   contextp->commandArgsPlusMatch("switch_host")[0] != '\0');
+        fabric->attach();
+        if (contextp->commandArgsPlusMatch("idle_skip")[0] != '\0') {
+            printf("Idle skip is disabled on a virtual switch node.\n");
+        }
+    }
+
+    // +idle_skip jumps over quiescent periods, +idle_check simulates them in
+    // full and validates every skip it would have taken instead
+    idle = new IdleSkip(fabric == NULL && contextp->commandArgsPlusMatch("idle_skip")[0] != '\0',
+                        fabric == NULL && contextp->commandArgsPlusMatch("idle_check")[0] != '\0',
+                        2 * top_clock->get_half_period(),
+                        plusarg_value(contextp.get(), "idle_window=", 4096),
+                        plusarg_value(contextp.get(), "idle_max=", UINT64_MAX),
+                        signature);
+    svSetScope(svGetScopeFromName("TOP.tb.idle_txr"));
+    uint64_t skip_cycles = 0;
+    uint32_t top_clock_state = top_clock->get_state();
+
     tb->i_reset = 1;
     tb->i_clock = top_clock->get_state();
     tb->i_uart_clock = uart_clock->get_state();
@@ -54,9 +117,34 @@ int main(int argc, char** argv, char** env) {
     tb->eval();
     tfp->dump(contextp->time());
     tfp->flush();
+
+    // The time scale is fixed when top.v is elaborated, +time_scale=<n>
+    // refuses to run a build with a different one
+    printf("Time scale is %u: reset debouncing, UART and mtime run %ux faster than in hardware.\n", tb->o_time_scale, tb->o_time_scale);
+    uint64_t time_scale = plusarg_value(contextp.get(), "time_scale=", tb->o_time_scale);
+    if (time_scale != tb->o_time_scale) {
+        printf("Time scale %lu was expected, rebuild top.v with a matching Parameters.TIME_SCALE.\n", time_scale);
+        if (fabric != NULL) {
+            fabric->detach();
+        }
+        tfp->close();
+        tb->final();
+        return 1;
+    }
+
     // Tick the clock until we are done
     while(!contextp->gotFinish()) {
-        contextp->timeInc(clocks.next_edge());
+        if (skip_cycles > 0) {
+            clocks.skip(skip_cycles * 2 * top_clock->get_half_period());
+            contextp->timeInc(skip_cycles * 2 * top_clock->get_half_period());
+            idle_advance(skip_cycles);
+            skip_cycles = 0;
+        }
+        uint64_t step = clocks.next_edge();
+        if (fabric != NULL) {
+            fabric->sync(contextp->time() + step);
+        }
+        contextp->timeInc(step);
         if (contextp->time() >= 100000) {
             tb->i_reset = 0;
         }
@@ -70,7 +158,16 @@ int main(int argc, char** argv, char** env) {
         tb->eval();
         tfp->dump(contextp->time());
         tfp->flush();
+        if (top_clock->get_state() && !top_clock_state) {
+            skip_cycles = idle->update(contextp->time(), tb->o_idle, tb->o_timer_cycles);
+        }
+        top_clock_state = top_clock->get_state();
+    }
+    if (fabric != NULL) {
+        fabric->detach();
+        fabric->report();
     }
+    idle->report();
     tfp->close();
     tb->final();
     return 0;
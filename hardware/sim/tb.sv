@@ -354,8 +354,13 @@ module tb (
     input i_hdmi_pixel_clock,
     input i_hdmi_audio_clock,
     input i_cpu_clock,
-    input i_reset
+    input i_reset,
+    output o_idle,
+    output [63:0] o_timer_cycles,
+    output [31:0] o_time_scale
 );
+
+    assign o_time_scale = top.time_scale;
     
     wire uart_txr_i_uart_rx;
     wire uart_txr_o_uart_tx;
@@ -388,6 +393,47 @@ module tb (
         .o_phy_tx_control(udp_txr_o_tx_control)
     );
 
+    wire iss_txr_o_debug_cmd_valid;
+    wire iss_txr_i_debug_cmd_ready;
+    wire iss_txr_o_debug_cmd_wr;
+    wire [7:0] iss_txr_o_debug_cmd_address;
+    wire [31:0] iss_txr_o_debug_cmd_data;
+    wire [31:0] iss_txr_i_debug_rsp_data;
+
+    iss_txr iss_txr (
+        .i_clock(i_clock),
+        .i_cpu_clock(i_cpu_clock),
+        .i_reset(i_reset),
+        .o_debug_cmd_valid(iss_txr_o_debug_cmd_valid),
+        .i_debug_cmd_ready(iss_txr_i_debug_cmd_ready),
+        .o_debug_cmd_wr(iss_txr_o_debug_cmd_wr),
+        .o_debug_cmd_address(iss_txr_o_debug_cmd_address),
+        .o_debug_cmd_data(iss_txr_o_debug_cmd_data),
+        .i_debug_rsp_data(iss_txr_i_debug_rsp_data)
+    );
+
+    wire [9:0] hdmi_txr_i_tmds_clock;
+    wire [9:0] hdmi_txr_i_tmds_0;
+    wire [9:0] hdmi_txr_i_tmds_1;
+    wire [9:0] hdmi_txr_i_tmds_2;
+
+    hdmi_txr hdmi_txr (
+        .i_hdmi_pixel_clock(i_hdmi_pixel_clock),
+        .i_reset(i_reset),
+        .i_tmds_clock(hdmi_txr_i_tmds_clock),
+        .i_tmds_0(hdmi_txr_i_tmds_0),
+        .i_tmds_1(hdmi_txr_i_tmds_1),
+        .i_tmds_2(hdmi_txr_i_tmds_2)
+    );
+
+    idle_txr idle_txr (
+        .i_clock(i_clock),
+        .i_cpu_clock(i_cpu_clock),
+        .i_reset(i_reset),
+        .o_idle(o_idle),
+        .o_timer_cycles(o_timer_cycles)
+    );
+
     wire [7:0] dram_axi_awid;
     wire [28:0] dram_axi_awaddr;
     wire [7:0] dram_axi_awlen;
@@ -517,7 +563,17 @@ module tb (
         .io_dram_r_bits_last(dram_axi_rlast),
         .io_hdmi_pixel_clock(i_hdmi_pixel_clock),
         .io_hdmi_audio_clock(i_hdmi_audio_clock),
-        .io_cpu_clock(i_cpu_clock)
+        .io_hdmi_tmds_clock(hdmi_txr_i_tmds_clock),
+        .io_hdmi_tmds_0(hdmi_txr_i_tmds_0),
+        .io_hdmi_tmds_1(hdmi_txr_i_tmds_1),
+        .io_hdmi_tmds_2(hdmi_txr_i_tmds_2),
+        .io_cpu_clock(i_cpu_clock),
+        .io_cpu_debug_cmd_ready(iss_txr_i_debug_cmd_ready),
+        .io_cpu_debug_cmd_valid(iss_txr_o_debug_cmd_valid),
+        .io_cpu_debug_cmd_bits_wr(iss_txr_o_debug_cmd_wr),
+        .io_cpu_debug_cmd_bits_address(iss_txr_o_debug_cmd_address),
+        .io_cpu_debug_cmd_bits_data(iss_txr_o_debug_cmd_data),
+        .io_cpu_debug_rsp_data(iss_txr_i_debug_rsp_data)
     );
 
 endmodule
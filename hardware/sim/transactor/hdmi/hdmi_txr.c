@@ -0,0 +1,530 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <deque>
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "svdpi.h"
+#include "Vtb__Dpi.h"
+
+#define HDMI_CHANNELS 3
+#define HDMI_PACKET_LENGTH 32
+#define HDMI_GUARD_BAND 0x133
+#define HDMI_VIDEO_GUARD_BAND_0 0x2CC
+#define HDMI_AUDIO_RATE 48000
+
+enum hdmi_period_t {
+    HDMI_CONTROL,
+    HDMI_VIDEO_GUARD,
+    HDMI_VIDEO,
+    HDMI_DATA_GUARD,
+    HDMI_DATA
+};
+
+enum hdmi_preamble_t {
+    HDMI_PREAMBLE_NONE,
+    HDMI_PREAMBLE_VIDEO,
+    HDMI_PREAMBLE_DATA
+};
+
+typedef struct {
+    int number;
+    int width;
+    int height;
+    std::vector<uint8_t> rgb;
+} hdmi_frame_t;
+
+typedef struct {
+    std::vector<uint8_t> pcm;
+} hdmi_audio_t;
+
+typedef struct {
+    // Writer thread
+    std::thread writer;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::deque<hdmi_frame_t*> frames;
+    std::deque<hdmi_audio_t*> audio;
+    bool stop;
+    std::string video_path;
+    std::string audio_path;
+    std::string golden_path;
+    std::vector<uint8_t> golden;
+    FILE* video_file;
+    FILE* audio_file;
+    uint32_t audio_bytes;
+
+    // Decoder
+    hdmi_period_t period;
+    hdmi_preamble_t preamble;
+    int guard_count;
+    int hsync;
+    int vsync;
+    int vsync_inactive;
+    int vsync_known;
+    hdmi_frame_t* frame;
+    int line_width;
+    int lines;
+    int packet_position;
+    uint32_t header;
+    uint64_t sub[4];
+    hdmi_audio_t* samples;
+
+    // Statistics
+    int frame_number;
+    long long last_frame_time;
+    uint64_t cycles;
+    uint64_t last_frame_cycles;
+    uint64_t symbol_errors;
+    uint64_t line_errors;
+    uint64_t ecc_errors;
+    uint64_t packets[256];
+    uint64_t audio_samples;
+    uint32_t acr_n;
+    uint32_t acr_cts;
+} hdmi_sink_t;
+
+static const uint16_t control_tokens[4] = {0x354, 0x0AB, 0x154, 0x2AB};
+
+static const uint16_t terc4_tokens[16] = {0x29C, 0x263, 0x2E4, 0x2E2, 0x171, 0x11E, 0x18E, 0x13C,
+                                          0x2CC, 0x139, 0x19C, 0x2C6, 0x28E, 0x271, 0x163, 0x2C3};
+
+static int decode_control(uint16_t symbol) {
+    for (int i = 0; i < 4; i++) {
+        if (symbol == control_tokens[i]) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int decode_terc4(uint16_t symbol) {
+    for (int i = 0; i < 16; i++) {
+        if (symbol == terc4_tokens[i]) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static uint8_t decode_video(uint16_t symbol) {
+    uint16_t data = (symbol & 0x200) ? (symbol ^ 0xFF) : symbol;
+    uint8_t result = data & 0x1;
+    for (int b = 1; b < 8; b++) {
+        int bit = ((data >> b) ^ (data >> (b - 1))) & 0x1;
+        if (!(symbol & 0x100)) {
+            bit ^= 1;
+        }
+        result |= bit << b;
+    }
+    return result;
+}
+
+static uint8_t bch_ecc(uint64_t data, int length) {
+    uint8_t ecc = 0;
+    for (int b = 0; b < length; b++) {
+        ecc = (ecc >> 1) ^ (((ecc ^ (data >> b)) & 0x1) ? 0x83 : 0x00);
+    }
+    return ecc;
+}
+
+static void write_wav_header(FILE* file, uint32_t data_bytes) {
+    uint32_t value;
+    uint16_t half;
+    fseek(file, 0, SEEK_SET);
+    fwrite("RIFF", 1, 4, file);
+    value = 36 + data_bytes;
+    fwrite(&value, 4, 1, file);
+    fwrite("WAVEfmt ", 1, 8, file);
+    value = 16;
+    fwrite(&value, 4, 1, file);
+    half = 1;
+    fwrite(&half, 2, 1, file);
+    half = 2;
+    fwrite(&half, 2, 1, file);
+    value = HDMI_AUDIO_RATE;
+    fwrite(&value, 4, 1, file);
+    value = HDMI_AUDIO_RATE * 2 * 3;
+    fwrite(&value, 4, 1, file);
+    half = 2 * 3;
+    fwrite(&half, 2, 1, file);
+    half = 24;
+    fwrite(&half, 2, 1, file);
+    fwrite("data", 1, 4, file);
+    fwrite(&data_bytes, 4, 1, file);
+    fseek(file, 0, SEEK_END);
+}
+
+static void write_frame(hdmi_sink_t* sink, hdmi_frame_t* frame) {
+    if (sink->video_path.size() > 4 && sink->video_path.compare(sink->video_path.size() - 4, 4, ".y4m") == 0) {
+        if (sink->video_file == NULL) {
+            sink->video_file = fopen(sink->video_path.c_str(), "wb");
+            if (sink->video_file == NULL) {
+                printf("HDMI cannot write video %s, video output is disabled.\n", sink->video_path.c_str());
+                sink->video_path.clear();
+                return;
+            }
+            fprintf(sink->video_file, "YUV4MPEG2 W%d H%d F60:1 Ip A1:1 C444\n", frame->width, frame->height);
+        }
+        int pixels = frame->width * frame->height;
+        std::vector<uint8_t> planes(pixels * 3);
+        for (int p = 0; p < pixels; p++) {
+            int r = frame->rgb[p * 3 + 0];
+            int g = frame->rgb[p * 3 + 1];
+            int b = frame->rgb[p * 3 + 2];
+            planes[p] = (uint8_t)((66 * r + 129 * g + 25 * b + 128) / 256 + 16);
+            planes[pixels + p] = (uint8_t)((-38 * r - 74 * g + 112 * b + 128) / 256 + 128);
+            planes[pixels * 2 + p] = (uint8_t)((112 * r - 94 * g - 18 * b + 128) / 256 + 128);
+        }
+        fprintf(sink->video_file, "FRAME\n");
+        fwrite(planes.data(), 1, planes.size(), sink->video_file);
+        fflush(sink->video_file);
+    } else {
+        char name[1024];
+        snprintf(name, sizeof(name), "%s%05d.ppm", sink->video_path.c_str(), frame->number);
+        FILE* file = fopen(name, "wb");
+        if (file != NULL) {
+            fprintf(file, "P6\n%d %d\n255\n", frame->width, frame->height);
+            fwrite(frame->rgb.data(), 1, frame->rgb.size(), file);
+            fclose(file);
+        }
+    }
+}
+
+static void compare_frame(hdmi_sink_t* sink, hdmi_frame_t* frame) {
+    if (sink->golden.size() != frame->rgb.size()) {
+        printf("HDMI frame %d: %dx%d does not match the golden image size.\n", frame->number, frame->width, frame->height);
+        return;
+    }
+    uint64_t mismatches = 0;
+    for (size_t p = 0; p < frame->rgb.size(); p += 3) {
+        if (memcmp(&(frame->rgb[p]), &(sink->golden[p]), 3) != 0) {
+            mismatches++;
+        }
+    }
+    printf("HDMI frame %d: %llu pixels differ from the golden image.\n", frame->number, (unsigned long long)mismatches);
+}
+
+static void writer_thread(hdmi_sink_t* sink) {
+    std::unique_lock<std::mutex> guard(sink->lock);
+    while (true) {
+        sink->wake.wait(guard, [sink] { return sink->stop || !sink->frames.empty() || !sink->audio.empty(); });
+        if (sink->frames.empty() && sink->audio.empty() && sink->stop) {
+            break;
+        }
+        std::deque<hdmi_frame_t*> frames;
+        std::deque<hdmi_audio_t*> audio;
+        frames.swap(sink->frames);
+        audio.swap(sink->audio);
+        guard.unlock();
+
+        for (hdmi_frame_t* frame : frames) {
+            if (!sink->golden.empty()) {
+                compare_frame(sink, frame);
+            }
+            if (!sink->video_path.empty()) {
+                write_frame(sink, frame);
+            }
+            delete frame;
+        }
+        for (hdmi_audio_t* chunk : audio) {
+            if (sink->audio_file != NULL) {
+                fwrite(chunk->pcm.data(), 1, chunk->pcm.size(), sink->audio_file);
+                sink->audio_bytes += chunk->pcm.size();
+                write_wav_header(sink->audio_file, sink->audio_bytes);
+                fflush(sink->audio_file);
+            }
+            delete chunk;
+        }
+
+        guard.lock();
+    }
+}
+
+static bool load_golden(hdmi_sink_t* sink) {
+    FILE* file = fopen(sink->golden_path.c_str(), "rb");
+    int width, height, depth;
+    if (file == NULL || fscanf(file, "P6 %d %d %d", &width, &height, &depth) != 3 || depth != 255) {
+        printf("HDMI cannot read golden image %s.\n", sink->golden_path.c_str());
+        if (file != NULL) {
+            fclose(file);
+        }
+        return false;
+    }
+    fgetc(file);
+    std::vector<uint8_t> golden(width * height * 3);
+    size_t size = fread(golden.data(), 1, golden.size(), file);
+    fclose(file);
+    if (size != golden.size()) {
+        printf("HDMI golden image %s is truncated, frames are not compared.\n", sink->golden_path.c_str());
+        return false;
+    }
+    sink->golden.swap(golden);
+    return true;
+}
+
+void* hdmi_create(const char* video_path, const char* audio_path, const char* golden_path) {
+    hdmi_sink_t* sink = new hdmi_sink_t();
+    sink->stop = false;
+    sink->video_path = video_path;
+    sink->audio_path = audio_path;
+    sink->golden_path = golden_path;
+    sink->video_file = NULL;
+    sink->audio_file = NULL;
+    sink->audio_bytes = 0;
+    sink->period = HDMI_CONTROL;
+    sink->preamble = HDMI_PREAMBLE_NONE;
+    sink->vsync_known = 0;
+    sink->frame = NULL;
+    sink->samples = new hdmi_audio_t();
+    sink->frame_number = 0;
+    sink->last_frame_time = -1;
+    sink->cycles = 0;
+    sink->last_frame_cycles = 0;
+
+    if (!sink->audio_path.empty()) {
+        sink->audio_file = fopen(sink->audio_path.c_str(), "wb");
+        if (sink->audio_file != NULL) {
+            write_wav_header(sink->audio_file, 0);
+        }
+    }
+    if (!sink->golden_path.empty()) {
+        if (!load_golden(sink)) {
+            sink->golden.clear();
+        }
+    }
+
+    sink->writer = std::thread(writer_thread, sink);
+
+    printf("HDMI sink is ready.\n");
+
+    return (void*) sink;
+}
+
+static void finish_frame(hdmi_sink_t* sink, long long time) {
+    hdmi_frame_t* frame = sink->frame;
+    sink->frame = NULL;
+    if (frame == NULL || sink->lines == 0) {
+        delete frame;
+        return;
+    }
+    frame->height = sink->lines;
+    frame->rgb.resize(frame->width * frame->height * 3);
+
+    // Simulation time is in picoseconds; the audio sample rate is recovered
+    // from the ACR packets as f_pixel * N / (128 * CTS)
+    if (sink->last_frame_time >= 0) {
+        double period = (time - sink->last_frame_time) / 1e12;
+        double pixel_frequency = (sink->cycles - sink->last_frame_cycles) / period;
+        printf("HDMI frame %d: %dx%d, %.2f fps, %llu symbol errors, %llu line errors, %llu ECC errors, %llu audio samples, ACR N=%u CTS=%u (%.1f Hz).\n",
+               frame->number, frame->width, frame->height, 1.0 / period,
+               (unsigned long long)sink->symbol_errors, (unsigned long long)sink->line_errors, (unsigned long long)sink->ecc_errors,
+               (unsigned long long)sink->audio_samples, sink->acr_n, sink->acr_cts,
+               sink->acr_cts ? pixel_frequency * sink->acr_n / (128.0 * sink->acr_cts) : 0.0);
+    }
+    sink->last_frame_time = time;
+    sink->last_frame_cycles = sink->cycles;
+
+    std::lock_guard<std::mutex> guard(sink->lock);
+    sink->frames.push_back(frame);
+    if (!sink->samples->pcm.empty()) {
+        sink->audio.push_back(sink->samples);
+        sink->samples = new hdmi_audio_t();
+    }
+    sink->wake.notify_one();
+}
+
+static void finish_packet(hdmi_sink_t* sink) {
+    int type = sink->header & 0xFF;
+    if (bch_ecc(sink->header, 24) != ((sink->header >> 24) & 0xFF)) {
+        sink->ecc_errors++;
+        return;
+    }
+    for (int i = 0; i < 4; i++) {
+        if (bch_ecc(sink->sub[i], 56) != ((sink->sub[i] >> 56) & 0xFF)) {
+            sink->ecc_errors++;
+            return;
+        }
+    }
+    sink->packets[type]++;
+    switch (type) {
+        case 0x01:
+            sink->acr_cts = ((sink->sub[0] >> 8) & 0xF) << 16 | ((sink->sub[0] >> 16) & 0xFF) << 8 | ((sink->sub[0] >> 24) & 0xFF);
+            sink->acr_n = ((sink->sub[0] >> 32) & 0xF) << 16 | ((sink->sub[0] >> 40) & 0xFF) << 8 | ((sink->sub[0] >> 48) & 0xFF);
+            break;
+        case 0x02:
+            for (int i = 0; i < 4; i++) {
+                if ((sink->header >> (8 + i)) & 0x1) {
+                    for (int b = 0; b < 6; b++) {
+                        sink->samples->pcm.push_back((sink->sub[i] >> (b * 8)) & 0xFF);
+                    }
+                    sink->audio_samples++;
+                }
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static void data_symbol(hdmi_sink_t* sink, int* terc4) {
+    int position = sink->packet_position;
+    if (position == 0) {
+        sink->header = 0;
+        memset(sink->sub, 0, sizeof(sink->sub));
+    }
+    sink->header |= (uint32_t)((terc4[0] >> 2) & 0x1) << position;
+    for (int i = 0; i < 4; i++) {
+        sink->sub[i] |= (uint64_t)((terc4[1] >> i) & 0x1) << (position * 2);
+        sink->sub[i] |= (uint64_t)((terc4[2] >> i) & 0x1) << (position * 2 + 1);
+    }
+    sink->packet_position = (position + 1) % HDMI_PACKET_LENGTH;
+    if (sink->packet_position == 0) {
+        finish_packet(sink);
+    }
+}
+
+static void video_symbol(hdmi_sink_t* sink, const uint16_t* tmds) {
+    if (sink->frame == NULL) {
+        sink->frame = new hdmi_frame_t();
+        sink->frame->number = sink->frame_number++;
+        sink->frame->width = 0;
+        sink->lines = 0;
+    }
+    hdmi_frame_t* frame = sink->frame;
+    frame->rgb.push_back(decode_video(tmds[2]));
+    frame->rgb.push_back(decode_video(tmds[1]));
+    frame->rgb.push_back(decode_video(tmds[0]));
+    sink->line_width++;
+}
+
+static void end_line(hdmi_sink_t* sink) {
+    hdmi_frame_t* frame = sink->frame;
+    if (frame == NULL) {
+        return;
+    }
+    if (sink->lines == 0) {
+        frame->width = sink->line_width;
+    } else if (sink->line_width != frame->width) {
+        sink->line_errors++;
+        frame->rgb.resize((sink->lines + 1) * frame->width * 3);
+    }
+    sink->lines++;
+}
+
+void hdmi_sample(void* handle, long long time, int tmds_0, int tmds_1, int tmds_2) {
+    hdmi_sink_t* sink = (hdmi_sink_t*)handle;
+    uint16_t tmds[HDMI_CHANNELS] = {(uint16_t)(tmds_0 & 0x3FF), (uint16_t)(tmds_1 & 0x3FF), (uint16_t)(tmds_2 & 0x3FF)};
+    int control[HDMI_CHANNELS];
+    sink->cycles++;
+    for (int c = 0; c < HDMI_CHANNELS; c++) {
+        control[c] = decode_control(tmds[c]);
+    }
+
+    if (control[0] >= 0) {
+        if (sink->period == HDMI_VIDEO) {
+            end_line(sink);
+        }
+        sink->period = HDMI_CONTROL;
+        sink->hsync = control[0] & 0x1;
+        int vsync = (control[0] >> 1) & 0x1;
+        if (sink->vsync_known && vsync != sink->vsync && vsync != sink->vsync_inactive) {
+            finish_frame(sink, time);
+        }
+        sink->vsync = vsync;
+        if (control[1] == 1 && control[2] == 0) {
+            sink->preamble = HDMI_PREAMBLE_VIDEO;
+        } else if (control[1] == 1 && control[2] == 1) {
+            sink->preamble = HDMI_PREAMBLE_DATA;
+        } else {
+            sink->preamble = HDMI_PREAMBLE_NONE;
+        }
+        return;
+    }
+
+    switch (sink->period) {
+        case HDMI_CONTROL:
+            sink->guard_count = 0;
+            if (sink->preamble == HDMI_PREAMBLE_VIDEO && tmds[0] == HDMI_VIDEO_GUARD_BAND_0 && tmds[1] == HDMI_GUARD_BAND) {
+                sink->period = HDMI_VIDEO_GUARD;
+                sink->guard_count = 1;
+            } else if (sink->preamble == HDMI_PREAMBLE_DATA && tmds[1] == HDMI_GUARD_BAND && tmds[2] == HDMI_GUARD_BAND) {
+                sink->period = HDMI_DATA_GUARD;
+                sink->guard_count = 1;
+            } else if (sink->preamble == HDMI_PREAMBLE_NONE) {
+                // DVI streams have no guard bands
+                sink->period = HDMI_VIDEO;
+                sink->line_width = 0;
+                video_symbol(sink, tmds);
+            } else {
+                sink->symbol_errors++;
+            }
+            break;
+        case HDMI_VIDEO_GUARD:
+            if (tmds[0] == HDMI_VIDEO_GUARD_BAND_0 && tmds[1] == HDMI_GUARD_BAND && sink->guard_count < 2) {
+                sink->guard_count++;
+                break;
+            }
+            sink->period = HDMI_VIDEO;
+            sink->line_width = 0;
+            if (!sink->vsync_known) {
+                sink->vsync_inactive = sink->vsync;
+                sink->vsync_known = 1;
+            }
+            video_symbol(sink, tmds);
+            break;
+        case HDMI_VIDEO:
+            video_symbol(sink, tmds);
+            break;
+        case HDMI_DATA_GUARD:
+        case HDMI_DATA: {
+            if (tmds[1] == HDMI_GUARD_BAND && tmds[2] == HDMI_GUARD_BAND) {
+                // Leading or trailing guard band
+                sink->packet_position = 0;
+                sink->guard_count++;
+                break;
+            }
+            int terc4[HDMI_CHANNELS];
+            for (int c = 0; c < HDMI_CHANNELS; c++) {
+                terc4[c] = decode_terc4(tmds[c]);
+            }
+            if (terc4[0] < 0 || terc4[1] < 0 || terc4[2] < 0) {
+                sink->symbol_errors++;
+                break;
+            }
+            sink->period = HDMI_DATA;
+            data_symbol(sink, terc4);
+            break;
+        }
+    }
+}
+
+void hdmi_close(void* handle) {
+    hdmi_sink_t* sink = (hdmi_sink_t*)handle;
+    {
+        std::lock_guard<std::mutex> guard(sink->lock);
+        sink->stop = true;
+        if (!sink->samples->pcm.empty()) {
+            sink->audio.push_back(sink->samples);
+            sink->samples = new hdmi_audio_t();
+        }
+        sink->wake.notify_one();
+    }
+    sink->writer.join();
+    if (sink->video_file != NULL) {
+        fclose(sink->video_file);
+    }
+    if (sink->audio_file != NULL) {
+        fclose(sink->audio_file);
+    }
+    printf("HDMI sink closed after %d frames, %llu symbol errors, %llu line errors, %llu ECC errors, %llu audio samples.\n",
+           sink->frame_number, (unsigned long long)sink->symbol_errors, (unsigned long long)sink->line_errors,
+           (unsigned long long)sink->ecc_errors, (unsigned long long)sink->audio_samples);
+    printf("HDMI packets: %llu ACR, %llu audio sample, %llu AVI, %llu SPD, %llu audio InfoFrame.\n",
+           (unsigned long long)sink->packets[0x01], (unsigned long long)sink->packets[0x02], (unsigned long long)sink->packets[0x82],
+           (unsigned long long)sink->packets[0x83], (unsigned long long)sink->packets[0x84]);
+}
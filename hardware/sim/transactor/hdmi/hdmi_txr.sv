@@ -0,0 +1,47 @@
+module hdmi_txr (
+    input i_hdmi_pixel_clock,
+    input i_reset,
+    input [9:0] i_tmds_clock,
+    input [9:0] i_tmds_0,
+    input [9:0] i_tmds_1,
+    input [9:0] i_tmds_2
+);
+
+    import "DPI-C" function
+        chandle hdmi_create(input string video, input string audio, input string golden);
+
+    import "DPI-C" function
+        void hdmi_sample(input chandle txr, longint time_ps, int tmds_0, int tmds_1, int tmds_2);
+
+    import "DPI-C" function
+        void hdmi_close(input chandle txr);
+
+    chandle txr;
+    string video;
+    string audio;
+    string golden;
+    bit enable;
+
+    // The grabber is enabled with +hdmi_video=<file> and/or +hdmi_audio=<file>.
+    // A video path ending in .y4m is written as a single Y4M stream, any other
+    // path is used as the prefix of one PPM file per frame. +hdmi_golden=<ppm>
+    // compares every frame against a reference image.
+    initial begin
+        if (!$value$plusargs("hdmi_video=%s", video)) video = "";
+        if (!$value$plusargs("hdmi_audio=%s", audio)) audio = "";
+        if (!$value$plusargs("hdmi_golden=%s", golden)) golden = "";
+        enable = video != "" || audio != "" || golden != "" || $test$plusargs("hdmi_stats");
+        if (enable) txr = hdmi_create(video, audio, golden);
+    end
+
+    always @(posedge i_hdmi_pixel_clock) begin
+        if (enable && !i_reset) begin
+            hdmi_sample(txr, $time, {22'b0, i_tmds_0}, {22'b0, i_tmds_1}, {22'b0, i_tmds_2});
+        end
+    end
+
+    final begin
+        if (enable) hdmi_close(txr);
+    end
+
+endmodule
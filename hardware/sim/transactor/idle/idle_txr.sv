@@ -0,0 +1,102 @@
+module idle_txr #(
+    // Retired instructions a loop has to run without changing state before
+    // the core counts as spinning
+    parameter LOOP_RETIRED = 64,
+    // Largest loop body in bytes that counts as a tight loop
+    parameter LOOP_SPAN = 32
+) (
+    input i_clock,
+    input i_cpu_clock,
+    input i_reset,
+    output o_idle,
+    output [63:0] o_timer_cycles
+);
+
+    export "DPI-C" function idle_advance;
+    export "DPI-C" function idle_signature;
+
+    // Moves the machine timer forward by the number of top clock cycles that
+    // were skipped, at TIME_SCALE ticks per cycle. Only called by the harness
+    // between evaluations.
+    /* verilator lint_off MULTIDRIVEN */
+    function void idle_advance(input longint cycles);
+        tb.top.mtime = tb.top.mtime + cycles * {32'b0, tb.top.time_scale};
+    endfunction
+    /* verilator lint_on MULTIDRIVEN */
+
+    // Summary of the architectural state used by the checker to compare a
+    // skipped interval with a fully simulated one
+    function longint idle_signature();
+        longint signature;
+        signature = 64'b0;
+        for (int r = 1; r < 32; r++) begin
+            signature = {signature[56:0], signature[63:57]} ^ {32'b0, tb.top.cpu.RegFilePlugin_regFile[r]};
+        end
+        return signature;
+    endfunction
+
+    //
+    // CPU is quiet when it sits in WFI, or when it keeps retiring the same
+    // few instructions without storing or changing any register
+    //
+
+    reg [31:0] loop_base;
+    reg [15:0] loop_retired;
+    wire cpu_store = tb.top.cpu.dBus_cmd_valid && tb.top.cpu.dBus_cmd_payload_wr;
+    wire cpu_register_write = tb.top.cpu.lastStageRegFileWrite_valid &&
+                              tb.top.cpu.lastStageRegFileWrite_payload_address != 5'b0 &&
+                              tb.top.cpu.lastStageRegFileWrite_payload_data != tb.top.cpu.RegFilePlugin_regFile[tb.top.cpu.lastStageRegFileWrite_payload_address];
+    wire cpu_outside_loop = tb.top.cpu.lastStagePc - loop_base >= LOOP_SPAN;
+
+    always @(posedge i_cpu_clock) begin
+        if (i_reset || cpu_store) begin
+            loop_base <= tb.top.cpu.lastStagePc;
+            loop_retired <= 16'b0;
+        end else if (tb.top.cpu.lastStageIsFiring) begin
+            if (cpu_register_write || cpu_outside_loop) begin
+                loop_base <= tb.top.cpu.lastStagePc;
+                loop_retired <= 16'b0;
+            end else if (loop_retired != LOOP_RETIRED) begin
+                loop_retired <= loop_retired + 16'b1;
+            end
+        end
+    end
+
+    wire cpu_quiet = tb.top.cpu.CsrPlugin_inWfi || loop_retired == LOOP_RETIRED;
+
+    //
+    // Bus, FIFOs, DMA, network, UART and transactors are quiet when nothing
+    // is in flight
+    //
+
+    wire axi_active = tb.top.axi_xbar.io_M_AXI_0_aw_valid || tb.top.axi_xbar.io_M_AXI_0_w_valid || tb.top.axi_xbar.io_M_AXI_0_b_valid ||
+                      tb.top.axi_xbar.io_M_AXI_0_ar_valid || tb.top.axi_xbar.io_M_AXI_0_r_valid ||
+                      tb.top.axi_xbar.io_M_AXI_1_aw_valid || tb.top.axi_xbar.io_M_AXI_1_w_valid || tb.top.axi_xbar.io_M_AXI_1_b_valid ||
+                      tb.top.axi_xbar.io_M_AXI_1_ar_valid || tb.top.axi_xbar.io_M_AXI_1_r_valid ||
+                      tb.top.axi_xbar.io_M_AXI_2_aw_valid || tb.top.axi_xbar.io_M_AXI_2_w_valid || tb.top.axi_xbar.io_M_AXI_2_b_valid ||
+                      tb.top.axi_xbar.io_M_AXI_2_ar_valid || tb.top.axi_xbar.io_M_AXI_2_r_valid ||
+                      tb.top.axi_xbar.io_M_AXI_3_aw_valid || tb.top.axi_xbar.io_M_AXI_3_w_valid || tb.top.axi_xbar.io_M_AXI_3_b_valid ||
+                      tb.top.axi_xbar.io_M_AXI_3_ar_valid || tb.top.axi_xbar.io_M_AXI_3_r_valid;
+    wire fifo_active = tb.top.uart_axi.rx_queue_io_deq_valid || tb.top.uart_axi.tx_queue_io_deq_valid ||
+                       tb.top.uart.rx_fifo_io_deq_valid || tb.top.uart.tx_fifo_io_deq_valid ||
+                       tb.top.network_io_rx_output_valid || tb.top.network_io_rx_header_valid ||
+                       tb.top.network_io_tx_input_valid || tb.top.network_io_tx_header_valid ||
+                       tb.top.network.ethernet_phy_io_rx_valid || tb.top.network.ethernet_phy.tx_fifo_io_deq_valid;
+    // A running audio DMA refills its FIFO from DRAM long after the last
+    // bus access, so the SoC is busy until the transfer is done
+    wire dma_active = tb.top.hdmi_audio_io_start && !tb.top.hdmi_audio_io_done;
+    wire link_active = tb.udp_txr_i_rx_control || tb.udp_txr_o_tx_control || !tb.uart_txr_i_uart_rx || !tb.uart_txr_o_uart_tx;
+    wire transactor_active = tb.udp_txr.udp_i_tx_valid || tb.uart_txr.uart_i_tx_data_valid || tb.iss_txr.o_debug_cmd_valid || tb.hdmi_txr.enable;
+
+    // Timer interrupt pending or compare armed
+    wire [63:0] mtimecmp = tb.top.register_file_io_output_3[63:0];
+    wire timer_armed = tb.top.register_file_io_output_3[64];
+    wire timer_pending = tb.top.register_file_io_output_2[0] || (timer_armed && tb.top.mtime >= mtimecmp);
+
+    assign o_idle = !i_reset && cpu_quiet && !axi_active && !fifo_active && !dma_active && !link_active && !transactor_active && !timer_pending;
+    // Top clock cycles until the compare fires, rounded up
+    wire [63:0] time_scale = {32'b0, tb.top.time_scale};
+    assign o_timer_cycles = !timer_armed ? 64'hFFFFFFFFFFFFFFFF :
+                            mtimecmp > tb.top.mtime ? (mtimecmp - tb.top.mtime + time_scale - 64'b1) / time_scale : 64'b0;
+
+endmodule
@@ -0,0 +1,121 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <deque>
+#include "svdpi.h"
+#include "Vtb__Dpi.h"
+#include "iss.h"
+
+typedef struct {
+    ISS* iss;
+    uint32_t until_pc;
+    uint64_t max_instructions;
+    uint32_t marker;
+    std::deque<iss_dram_word_t> dram_words;
+    std::deque<iss_debug_cmd_t> commands;
+    int halted;
+    int waiting;
+    int confirmed;
+} iss_txr_t;
+
+static const char* stop_reasons[] = {"none", "pc", "instruction count", "marker", "wfi", "ebreak", "trap"};
+
+void* iss_create(const char* elf, int until_pc, long long max_instructions, int marker) {
+    iss_txr_t* txr = new iss_txr_t();
+    txr->iss = new ISS();
+    txr->halted = 0;
+    txr->waiting = 0;
+    txr->confirmed = 0;
+    txr->until_pc = (uint32_t)until_pc;
+    txr->max_instructions = (uint64_t)max_instructions;
+    txr->marker = (uint32_t)marker;
+
+    if (!txr->iss->load_elf(elf)) {
+        exit(1);
+    }
+
+    return (void*) txr;
+}
+
+// Fast-forwards the firmware once the time scale of the elaborated top is
+// known, so the ISS mtime advances at the same rate as the RTL one
+void iss_run(void* txr, int time_scale) {
+    iss_txr_t* t = (iss_txr_t*)txr;
+    t->iss->set_time_scale((uint32_t)time_scale);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ISSStopReason reason = t->iss->run(t->until_pc, t->max_instructions, t->marker);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    t->iss->dram_words(t->dram_words);
+    t->iss->handoff_commands(t->commands);
+
+    printf("ISS stopped on %s after %llu instructions in %.3f s (%.1f MIPS).\n", stop_reasons[reason], (unsigned long long)t->iss->get_instret(), seconds, t->iss->get_instret() / seconds / 1e6);
+    printf("ISS handing over %lu DRAM words and %lu debug commands.\n", t->dram_words.size(), t->commands.size());
+}
+
+int iss_dram_valid(void* txr) {
+    return !((iss_txr_t*)txr)->dram_words.empty();
+}
+
+int iss_dram_index(void* txr) {
+    return ((iss_txr_t*)txr)->dram_words.front().index;
+}
+
+void iss_dram_data(void* txr, svBitVecVal* data) {
+    iss_txr_t* t = (iss_txr_t*)txr;
+    memcpy(data, t->dram_words.front().data, ISS_DRAM_WORD_SIZE);
+    t->dram_words.pop_front();
+}
+
+int iss_debug_valid(void* txr, svBit* wr, int* address, int* data) {
+    iss_txr_t* t = (iss_txr_t*)txr;
+    if (t->waiting) {
+        return 0;
+    }
+    if (!t->halted) {
+        // Request a halt and read back the status until the pipeline drains
+        *wr = 1;
+        *address = ISS_DEBUG_STATUS_ADDRESS;
+        *data = ISS_DEBUG_HALT_SET;
+        t->commands.push_front({0, ISS_DEBUG_STATUS_ADDRESS, 0});
+        t->halted = 1;
+        return 1;
+    }
+    if (t->commands.empty()) {
+        return 0;
+    }
+    iss_debug_cmd_t cmd = t->commands.front();
+    t->commands.pop_front();
+    *wr = cmd.wr;
+    *address = cmd.address;
+    *data = cmd.data;
+    t->waiting = !cmd.wr;
+    if (t->commands.empty()) {
+        printf("ISS handoff complete, RTL core resumed.\n");
+    }
+    return 1;
+}
+
+// Returns 1 once, when the core is first seen halted with an empty pipeline
+int iss_debug_rsp(void* txr, int data) {
+    iss_txr_t* t = (iss_txr_t*)txr;
+    t->waiting = 0;
+    if (!(data & ISS_DEBUG_HALTED)) {
+        // Halt request was lost while the core was held in reset
+        t->halted = 0;
+    } else if (data & ISS_DEBUG_PIPELINE_BUSY) {
+        t->commands.push_front({0, ISS_DEBUG_STATUS_ADDRESS, 0});
+    } else if (!t->confirmed) {
+        t->confirmed = 1;
+        return 1;
+    }
+    return 0;
+}
+
+long long iss_mtime(void* txr) {
+    return (long long)((iss_txr_t*)txr)->iss->get_mtime();
+}
@@ -0,0 +1,107 @@
+module iss_txr (
+    input i_clock,
+    input i_cpu_clock,
+    input i_reset,
+    output reg o_debug_cmd_valid,
+    input i_debug_cmd_ready,
+    output reg o_debug_cmd_wr,
+    output reg [7:0] o_debug_cmd_address,
+    output reg [31:0] o_debug_cmd_data,
+    input [31:0] i_debug_rsp_data
+);
+
+    import "DPI-C" function
+        chandle iss_create(input string elf, int until_pc, longint max_instructions, int marker);
+
+    import "DPI-C" function
+        void iss_run(input chandle txr, int time_scale);
+
+    import "DPI-C" function
+        int iss_dram_valid(input chandle txr);
+
+    import "DPI-C" function
+        int iss_dram_index(input chandle txr);
+
+    import "DPI-C" function
+        void iss_dram_data(input chandle txr, output bit [127:0] data);
+
+    import "DPI-C" function
+        int iss_debug_valid(input chandle txr, output bit wr, output int address, output int data);
+
+    import "DPI-C" function
+        int iss_debug_rsp(input chandle txr, int data);
+
+    import "DPI-C" function
+        longint iss_mtime(input chandle txr);
+
+    chandle txr;
+    string elf;
+    int until_pc;
+    longint max_instructions;
+    int marker;
+    bit enable;
+    bit started = 1'b0;
+
+    // Fast-forwarding is enabled with +iss_elf=<file> and stops at the first
+    // of +iss_until_pc=<hex>, +iss_max_instructions=<dec> or the instruction
+    // word +iss_marker=<hex>.
+    initial begin
+        enable = $value$plusargs("iss_elf=%s", elf);
+        if (!$value$plusargs("iss_until_pc=%h", until_pc)) until_pc = 32'hFFFFFFFF;
+        if (!$value$plusargs("iss_max_instructions=%d", max_instructions)) max_instructions = 64'h7FFFFFFFFFFFFFFF;
+        if (!$value$plusargs("iss_marker=%h", marker)) marker = 32'h0;
+        if (enable) txr = iss_create(elf, until_pc, max_instructions, marker);
+    end
+
+    // The firmware is fast-forwarded on the first clock of reset and its
+    // memory image is copied into the DRAM model while the SoC is held in
+    // reset
+    /* verilator lint_off MULTIDRIVEN */
+    always @(posedge i_clock) begin
+        if (enable && i_reset) begin
+            if (!started) begin
+                iss_run(txr, tb.top.time_scale);
+                started = 1'b1;
+            end
+            while (iss_dram_valid(txr) == 32'b1) begin
+                bit [127:0] data;
+                int index;
+                index = iss_dram_index(txr);
+                iss_dram_data(txr, data);
+                tb.dram.mem[index[24:0]] = data;
+            end
+        end
+    end
+    /* verilator lint_on MULTIDRIVEN */
+
+    reg debug_rsp_pending;
+
+    always @(posedge i_cpu_clock) begin
+        if (i_reset || !enable) begin
+            o_debug_cmd_valid <= 1'b0;
+            o_debug_cmd_wr <= 1'b0;
+            o_debug_cmd_address <= 8'b0;
+            o_debug_cmd_data <= 32'b0;
+            debug_rsp_pending <= 1'b0;
+        end else begin
+            debug_rsp_pending <= o_debug_cmd_valid && i_debug_cmd_ready && !o_debug_cmd_wr;
+            // Once the core is halted the RTL timer continues from the time
+            // the ISS reached, before mtimecmp is restored by the handoff
+            /* verilator lint_off MULTIDRIVEN */
+            if (debug_rsp_pending && iss_debug_rsp(txr, i_debug_rsp_data) == 32'b1) begin
+                tb.top.mtime = iss_mtime(txr);
+            end
+            /* verilator lint_on MULTIDRIVEN */
+            if (!o_debug_cmd_valid || i_debug_cmd_ready) begin
+                bit wr;
+                int address;
+                int data;
+                o_debug_cmd_valid <= iss_debug_valid(txr, wr, address, data) == 32'b1;
+                o_debug_cmd_wr <= wr;
+                o_debug_cmd_address <= address[7:0];
+                o_debug_cmd_data <= data;
+            end
+        end
+    end
+
+endmodule
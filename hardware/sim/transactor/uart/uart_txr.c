@@ -6,6 +6,7 @@
 #include <stdio.h>
 #include "svdpi.h"
 #include "Vtb__Dpi.h"
+#include "idle.h"
 
 typedef struct {
     char name[64];
@@ -27,6 +28,7 @@ void* uart_create(const char* name) {
     printf("UART at Device: %s is ready.\n", port->name);
     
     fcntl(port->master, F_SETFL, fcntl(port->master, F_GETFL, 0) | O_NONBLOCK);
+    idle_register_fd(port->master);
 
     return (void*) port;
 }
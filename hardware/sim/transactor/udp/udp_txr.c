@@ -3,6 +3,7 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <string.h>
+#include <stdint.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <net/if.h>
@@ -16,19 +17,40 @@
 #include <linux/if_packet.h>
 #include <arpa/inet.h>
 #include <errno.h>
+#include <unordered_map>
 #include "svdpi.h"
 #include "Vtb__Dpi.h"
+#include "idle.h"
+#include "switch.h"
 
 #define BUFFER_SIZE 4096
 #define IP_ADDRESS "127.0.0.128"
 #define INTERFACE "lo"
-#define MAX_PORTS 100
+#define MAX_PORTS 65536
+#define UDP_HEADER_SIZE 42
+
+typedef struct {
+    struct sockaddr_in address;
+    uint64_t requests;
+    uint64_t request_bytes;
+    uint64_t replies;
+    uint64_t reply_bytes;
+} udp_flow_t;
 
 typedef struct {
     int fd;
+    int port_number;
     struct sockaddr_in server_address;
     struct sockaddr_in client_address;
     unsigned int client_address_length;
+    int has_client;
+    // Host clients seen on this port, keyed by (IP address << 16) | port
+    std::unordered_map<uint64_t, udp_flow_t> flows;
+    uint64_t requests;
+    uint64_t request_bytes;
+    uint64_t replies;
+    uint64_t reply_bytes;
+    uint64_t unsolicited;
 } udp_master_t;
 
 typedef struct {
@@ -39,9 +61,12 @@ typedef struct {
     int data_length;
     int rx_pointer;
     int tx_pointer;
-    int port_numbers[MAX_PORTS];
+    // Indexed directly by UDP port number
     udp_master_t* ports[MAX_PORTS];
     int n_ports;
+    uint64_t unmapped;
+    // Set when the SoC is a node on the virtual switch instead of the host
+    VirtualSwitch* fabric;
 } eth_master_t;
 
 char* get_destination_ip(char* buffer);
@@ -57,15 +82,48 @@ void print_udp_packet(char* buffer, int size);
 void print_icmp_packet(char* buffer, int size);
 void print_data(char* data , int size);
 
+static uint64_t flow_key(struct sockaddr_in* address) {
+    return ((uint64_t)ntohl(address->sin_addr.s_addr) << 16) | ntohs(address->sin_port);
+}
+
+static int is_udp(char* buffer) {
+    struct iphdr *iph = (struct iphdr*)(buffer + sizeof(struct ethhdr));
+    return iph->protocol == 17;
+}
+
+static void get_source_address(char* buffer, struct sockaddr_in* address) {
+    struct iphdr *iph = (struct iphdr*)(buffer + sizeof(struct ethhdr));
+    bzero(address, sizeof(*address));
+    address->sin_family = AF_INET;
+    address->sin_addr.s_addr = iph->saddr;
+    address->sin_port = htons((in_port_t)get_source_port(buffer));
+}
+
+static void get_destination_address(char* buffer, struct sockaddr_in* address) {
+    struct iphdr *iph = (struct iphdr*)(buffer + sizeof(struct ethhdr));
+    bzero(address, sizeof(*address));
+    address->sin_family = AF_INET;
+    address->sin_addr.s_addr = iph->daddr;
+    address->sin_port = htons((in_port_t)get_destination_port(buffer));
+}
+
 void* eth_create() {
-    eth_master_t* eth = (eth_master_t*)malloc(sizeof(*eth));
+    eth_master_t* eth = new eth_master_t();
     eth->data_length = 0;
     eth->tx_pointer = 0;
     eth->rx_pointer = 0;
     eth->n_ports = 0;
+    eth->unmapped = 0;
+    eth->fabric = VirtualSwitch::get();
 
     bzero(&(eth->server_address), sizeof(eth->server_address));
 
+    if (eth->fabric != NULL) {
+        eth->fd = -1;
+        printf("Ethernet is attached to the virtual switch.\n");
+        return (void*) eth;
+    }
+
     eth->fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
     (eth->server_address).sll_family = AF_PACKET;
     (eth->server_address).sll_ifindex = if_nametoindex(INTERFACE);
@@ -74,16 +132,33 @@ void* eth_create() {
     fcntl(eth->fd, F_SETFL, fcntl(eth->fd, F_GETFL, 0) | O_NONBLOCK);
 
     bind(eth->fd, (struct sockaddr*)&(eth->server_address), sizeof(eth->server_address));
+    idle_register_fd(eth->fd);
 
     return (void*) eth;
 }
 
+// Maps a SoC UDP port. Replies are sent back to whichever host client sent
+// the request; source_port, if non-zero, names a fixed 127.0.0.1 client
+// that receives traffic the SoC originates on this port.
 void udp_create(void* eth, int port_number, int source_port) {
-    udp_master_t* port = (udp_master_t*)malloc(sizeof(*port));
-    
+    eth_master_t* e = (eth_master_t*)eth;
+    if (port_number <= 0 || port_number >= MAX_PORTS || e->ports[port_number] != NULL) {
+        printf("UDP Port: %d cannot be mapped.\n", port_number);
+        return;
+    }
+
+    udp_master_t* port = new udp_master_t();
+    port->port_number = port_number;
+    port->has_client = source_port > 0;
+    port->requests = 0;
+    port->request_bytes = 0;
+    port->replies = 0;
+    port->reply_bytes = 0;
+    port->unsolicited = 0;
+
     bzero(&(port->server_address), sizeof(port->server_address));
     bzero(&(port->client_address), sizeof(port->client_address));
-    
+
     port->fd = socket(AF_INET, SOCK_DGRAM, 0);
     (port->server_address).sin_family = AF_INET;
     (port->server_address).sin_addr.s_addr = inet_addr(IP_ADDRESS);
@@ -92,34 +167,76 @@ void udp_create(void* eth, int port_number, int source_port) {
     (port->client_address).sin_family = AF_INET;
     (port->client_address).sin_addr.s_addr = inet_addr("127.0.0.1");
     (port->client_address).sin_port = htons((in_port_t)source_port);
-    
+
     fcntl(port->fd, F_SETFL, fcntl(port->fd, F_GETFL, 0) | O_NONBLOCK);
-    
+
     bind(port->fd, (struct sockaddr*)&(port->server_address), sizeof(port->server_address));
 
-    port->client_address_length = sizeof(((udp_master_t*)port)->client_address);
+    port->client_address_length = sizeof(port->client_address);
 
-    ((eth_master_t*)eth)->port_numbers[((eth_master_t*)eth)->n_ports] = port_number;
-    ((eth_master_t*)eth)->ports[((eth_master_t*)eth)->n_ports] = port;
-    ((eth_master_t*)eth)->n_ports++;
+    e->ports[port_number] = port;
+    e->n_ports++;
 
     printf("UDP on IP Address: %s Port: %d is ready.\n", IP_ADDRESS, port_number);
 
     return;
 }
 
+// Maps every port in a comma separated list of <port>[:<source_port>]
+void udp_configure(void* eth, const char* mappings) {
+    if (((eth_master_t*)eth)->fabric != NULL) {
+        printf("UDP ports are reached through the virtual switch host bridge.\n");
+        return;
+    }
+    const char* mapping = mappings;
+    while (*mapping != '\0') {
+        char* end;
+        int port_number = (int)strtol(mapping, &end, 0);
+        int source_port = 0;
+        if (*end == ':') {
+            source_port = (int)strtol(end + 1, &end, 0);
+        }
+        if (end == mapping || (*end != ',' && *end != '\0')) {
+            printf("UDP port mapping %s is malformed.\n", mappings);
+            return;
+        }
+        udp_create(eth, port_number, source_port);
+        mapping = (*end == ',') ? end + 1 : end;
+    }
+}
+
 int eth_tx_valid(void* eth) {
-    if (((eth_master_t*)eth)->tx_pointer == 0) {
-        recvfrom(((eth_master_t*)eth)->fd, ((eth_master_t*)eth)->tx_buffer, sizeof(((eth_master_t*)eth)->tx_buffer), 0, NULL, NULL);
-        int size = recvfrom(((eth_master_t*)eth)->fd, ((eth_master_t*)eth)->tx_buffer, sizeof(((eth_master_t*)eth)->tx_buffer), 0, NULL, NULL);
-        if (size > 0 && strcmp(get_destination_ip(((eth_master_t*)eth)->tx_buffer), IP_ADDRESS) == 0) {
-            ((eth_master_t*)eth)->tx_buffer[size] = '\0';
-            process_packet(((eth_master_t*)eth)->tx_buffer, size);
-            ((eth_master_t*)eth)->data_length = size;
-            ((eth_master_t*)eth)->tx_pointer = size;
+    eth_master_t* e = (eth_master_t*)eth;
+    if (e->tx_pointer == 0 && e->fabric != NULL) {
+        int size = e->fabric->receive((uint8_t*)e->tx_buffer, sizeof(e->tx_buffer) - 1);
+        e->data_length = size;
+        e->tx_pointer = size;
+    } else if (e->tx_pointer == 0) {
+        recvfrom(e->fd, e->tx_buffer, sizeof(e->tx_buffer), 0, NULL, NULL);
+        int size = recvfrom(e->fd, e->tx_buffer, sizeof(e->tx_buffer), 0, NULL, NULL);
+        if (size > 0 && strcmp(get_destination_ip(e->tx_buffer), IP_ADDRESS) == 0) {
+            e->tx_buffer[size] = '\0';
+            process_packet(e->tx_buffer, size);
+            if (is_udp(e->tx_buffer)) {
+                udp_master_t* udp_port = e->ports[get_destination_port(e->tx_buffer)];
+                if (udp_port != NULL) {
+                    struct sockaddr_in client;
+                    get_source_address(e->tx_buffer, &client);
+                    udp_flow_t& flow = udp_port->flows[flow_key(&client)];
+                    flow.address = client;
+                    flow.requests++;
+                    flow.request_bytes += size - UDP_HEADER_SIZE;
+                    udp_port->requests++;
+                    udp_port->request_bytes += size - UDP_HEADER_SIZE;
+                } else {
+                    e->unmapped++;
+                }
+            }
+            e->data_length = size;
+            e->tx_pointer = size;
         }
     }
-    return ((eth_master_t*)eth)->tx_pointer;
+    return e->tx_pointer;
 }
 
 char eth_tx_data(void* eth) {
@@ -131,27 +248,65 @@ char eth_tx_data(void* eth) {
 }
 
 void eth_rx(void* eth, char data, int last) {
-    ((eth_master_t*)eth)->rx_buffer[((eth_master_t*)eth)->rx_pointer] = data;
-    ((eth_master_t*)eth)->rx_pointer += 1;
-    if (last) {
-        ((eth_master_t*)eth)->rx_buffer[((eth_master_t*)eth)->rx_pointer] = '\0';
-        if (strcmp(get_source_ip(((eth_master_t*)eth)->rx_buffer), IP_ADDRESS) == 0) {
-            int port = get_source_port(((eth_master_t*)eth)->rx_buffer);
-            char* data = get_data(((eth_master_t*)eth)->rx_buffer);
-            int port_index = -1;
-            process_packet(((eth_master_t*)eth)->rx_buffer, ((eth_master_t*)eth)->rx_pointer);
-            for (int i = 0; i < ((eth_master_t*)eth)->n_ports && port_index == -1; i++) {
-                if (port == ((eth_master_t*)eth)->port_numbers[i]) {
-                    port_index = i;
+    eth_master_t* e = (eth_master_t*)eth;
+    if (e->rx_pointer < BUFFER_SIZE - 1) {
+        e->rx_buffer[e->rx_pointer] = data;
+        e->rx_pointer += 1;
+    }
+    if (last && e->fabric != NULL) {
+        e->fabric->send((uint8_t*)e->rx_buffer, e->rx_pointer);
+        e->rx_pointer = 0;
+    } else if (last) {
+        e->rx_buffer[e->rx_pointer] = '\0';
+        if (strcmp(get_source_ip(e->rx_buffer), IP_ADDRESS) == 0 && is_udp(e->rx_buffer)) {
+            udp_master_t* udp_port = e->ports[get_source_port(e->rx_buffer)];
+            char* data = get_data(e->rx_buffer);
+            int length = e->rx_pointer - UDP_HEADER_SIZE;
+            process_packet(e->rx_buffer, e->rx_pointer);
+            if (udp_port != NULL) {
+                struct sockaddr_in client;
+                get_destination_address(e->rx_buffer, &client);
+                std::unordered_map<uint64_t, udp_flow_t>::iterator flow = udp_port->flows.find(flow_key(&client));
+                if (flow != udp_port->flows.end()) {
+                    flow->second.replies++;
+                    flow->second.reply_bytes += length;
+                } else {
+                    // Traffic originated by the SoC rather than a reply
+                    udp_port->unsolicited++;
+                    if (udp_port->has_client) {
+                        client = udp_port->client_address;
+                    }
                 }
+                udp_port->replies++;
+                udp_port->reply_bytes += length;
+                sendto(udp_port->fd, data, length, 0, (struct sockaddr*)&client, sizeof(client));
+            } else {
+                e->unmapped++;
             }
-            if (port_index >= 0) {
-                udp_master_t* udp_port = ((eth_master_t*)eth)->ports[port_index];
-                sendto(((udp_master_t*)udp_port)->fd, data, ((eth_master_t*)eth)->rx_pointer - 42, 0, (struct sockaddr*)&(((udp_master_t*)udp_port)->client_address), ((udp_master_t*)udp_port)->client_address_length);
-                ((eth_master_t*)eth)->rx_pointer = 0;
-            }
+        }
+        e->rx_pointer = 0;
+    }
+}
+
+void eth_close(void* eth) {
+    eth_master_t* e = (eth_master_t*)eth;
+    for (int i = 0; i < MAX_PORTS; i++) {
+        udp_master_t* udp_port = e->ports[i];
+        if (udp_port == NULL) {
+            continue;
+        }
+        printf("UDP Port: %d received %llu requests (%llu bytes), sent %llu datagrams (%llu bytes), %llu unsolicited, %lu clients.\n",
+               udp_port->port_number, (unsigned long long)udp_port->requests, (unsigned long long)udp_port->request_bytes,
+               (unsigned long long)udp_port->replies, (unsigned long long)udp_port->reply_bytes,
+               (unsigned long long)udp_port->unsolicited, udp_port->flows.size());
+        for (std::unordered_map<uint64_t, udp_flow_t>::iterator flow = udp_port->flows.begin(); flow != udp_port->flows.end(); flow++) {
+            printf("    Client: %s:%d %llu requests (%llu bytes), %llu replies (%llu bytes).\n",
+                   inet_ntoa(flow->second.address.sin_addr), ntohs(flow->second.address.sin_port),
+                   (unsigned long long)flow->second.requests, (unsigned long long)flow->second.request_bytes,
+                   (unsigned long long)flow->second.replies, (unsigned long long)flow->second.reply_bytes);
         }
     }
+    printf("UDP saw %llu frames for unmapped ports.\n", (unsigned long long)e->unmapped);
 }
 
 char* get_destination_ip(char* buffer) {
@@ -17,6 +17,12 @@ module udp_txr (
     import "DPI-C" function
         void udp_create(input chandle eth, int port_number, int source_port);
 
+    import "DPI-C" function
+        void udp_configure(input chandle eth, input string mappings);
+
+    import "DPI-C" function
+        void eth_close(input chandle eth);
+
     import "DPI-C" function
         int eth_tx_valid(input chandle eth);
         
@@ -27,12 +33,19 @@ module udp_txr (
         void eth_rx(input chandle eth, byte data, int last);
     
     chandle eth;
+    string ports;
 
+    // Ports are mapped with +udp_ports=<port>[:<source_port>],... where the
+    // optional source port is a fixed 127.0.0.1 client for traffic the SoC
+    // originates. Replies always go back to the client that sent the request.
     initial begin
         eth = eth_create();
-        udp_create(eth, 1234, 40000);
-        udp_create(eth, 1235, 40001);
-        udp_create(eth, 1236, 40002);
+        if (!$value$plusargs("udp_ports=%s", ports)) ports = "1234:40000,1235:40001,1236:40002";
+        udp_configure(eth, ports);
+    end
+
+    final begin
+        eth_close(eth);
     end
 
     wire udp_i_rx_ready;
@@ -898,7 +898,13 @@ module syn (
         .io_hdmi_tmds_0(hdmi_tmds_0),
         .io_hdmi_tmds_1(hdmi_tmds_1),
         .io_hdmi_tmds_2(hdmi_tmds_2),
-        .io_cpu_clock(cpu_clock)
+        .io_cpu_clock(cpu_clock),
+        .io_cpu_debug_cmd_ready(),
+        .io_cpu_debug_cmd_valid(1'b0),
+        .io_cpu_debug_cmd_bits_wr(1'b0),
+        .io_cpu_debug_cmd_bits_address(8'b0),
+        .io_cpu_debug_cmd_bits_data(32'b0),
+        .io_cpu_debug_rsp_data()
     );
 
 endmodule
\ No newline at end of file